@@ -0,0 +1,253 @@
+import sys
+import os
+import re
+import csv
+import glob
+import math
+import subprocess
+from pathlib import Path
+
+# Keep parameters synced
+from build_all import KERNELS
+from resource_utils import get_resources
+
+
+EXP_DATA_DIR = 'exp_data/'
+ANALYZER_BIN = 'dependency_analyzer/bin/dependency_analyzer'
+
+# {ld ports, st ports} of the StoreQueue in every kernel_dynamic.hpp.
+KERNEL_PORTS = {
+    'histogram' : (1, 1),
+    'histogram_if' : (1, 1),
+    'spmv' : (2, 1),
+    'maximal_matching' : (2, 2),
+    'get_tanh' : (1, 1),
+}
+VARIANTS = ['static', 'dynamic', 'dynamic_no_forward']
+# Modelled quantities: the resources minimized by the tuner, and the clock period (ns).
+RESOURCES = ['aluts', 'regs', 'rams']
+MODELLED = RESOURCES + ['period']
+# Builds of the committed reports (make fpga / make fpga_hw), newest first.
+BUILDS = ['fpga_hw', 'fpga']
+
+
+def get_reports():
+    """ All committed acl_quartus_report.txt of a KERNELS config, as dicts. """
+    reports = []
+    for kernel in KERNELS:
+        for prj in glob.glob(f'{kernel}/bin/*.prj'):
+            match = re.fullmatch(rf'{kernel}/bin/{kernel}_({"|".join(VARIANTS)})(?:_(\d+)qsize)?'
+                                 rf'\.({"|".join(BUILDS)})\.prj', prj)
+            if not match:
+                continue
+            res = get_resources(prj[:-len('.prj')])
+            if int(res['freq']) == 0:
+                continue
+            variant, q_size, build = match.groups()
+            reports.append({'kernel' : kernel, 'variant' : variant, 'build' : build,
+                            'q_size' : int(q_size or 0), 'aluts' : res['aluts'],
+                            'regs' : res['regs'], 'rams' : res['rams'],
+                            'period' : 1000.0 / int(res['freq'])})
+    return reports
+
+
+def features(kernel, variant, build, q_size):
+    """
+    Linear model of a resource (or the clock period) of a config:
+      base[kernel] + offset[variant, build] + q_size * (ld_ports * st_ports * search[variant]
+                                                        + st_ports * entries[variant])
+    The static kernel is the reference (offset 0, in any build), so kernels with reports of only
+    some variants are still predicted. The search logic compares every load port with every store
+    entry, the entries are per port.
+    """
+    num_ld, num_st = KERNEL_PORTS[kernel]
+    x = {f'base_{kernel}' : 1.0}
+    if variant != 'static':
+        x[f'offset_{variant}_{build}'] = 1.0
+        x[f'search_{variant}'] = q_size * num_ld * num_st
+        x[f'entries_{variant}'] = q_size * num_st
+    return x
+
+
+def solve(a, b):
+    """ Solves a x = b by Gaussian elimination with partial pivoting. """
+    n = len(b)
+    m = [row[:] + [b[i]] for i, row in enumerate(a)]
+    for c in range(n):
+        p = max(range(c, n), key=lambda r: abs(m[r][c]))
+        m[c], m[p] = m[p], m[c]
+        for r in range(c + 1, n):
+            f = m[r][c] / m[c][c]
+            for k in range(c, n + 1):
+                m[r][k] -= f * m[c][k]
+    x = [0.0] * n
+    for r in range(n - 1, -1, -1):
+        x[r] = (m[r][n] - sum(m[r][k] * x[k] for k in range(r + 1, n))) / m[r][r]
+    return x
+
+
+def fit_model(reports, ridge=1e-3):
+    """ Least-squares fit of the features() coefficients of every MODELLED quantity. """
+    names = sorted({name for r in reports
+                    for name in features(r['kernel'], r['variant'], r['build'], r['q_size'])})
+    rows = [features(r['kernel'], r['variant'], r['build'], r['q_size']) for r in reports]
+
+    model = {}
+    for y_name in MODELLED:
+        # Normal equations, with a small ridge for coefficients the reports do not pin down.
+        ata = [[sum(x.get(i, 0) * x.get(j, 0) for x in rows) + (ridge if i == j else 0)
+                for j in names] for i in names]
+        aty = [sum(x.get(i, 0) * r[y_name] for x, r in zip(rows, reports)) for i in names]
+        model[y_name] = dict(zip(names, solve(ata, aty)))
+    return model
+
+
+def predict(model, kernel, variant, build, q_size):
+    x = features(kernel, variant, build, q_size)
+    return {y_name : sum(coef.get(name, 0) * v for name, v in x.items())
+            for y_name, coef in model.items()}
+
+
+def model_error(model, reports):
+    """ Mean absolute relative error of the model on the reports, per MODELLED quantity. """
+    err = {y_name : 0.0 for y_name in MODELLED}
+    for r in reports:
+        pred = predict(model, r['kernel'], r['variant'], r['build'], r['q_size'])
+        for y_name in MODELLED:
+            err[y_name] += abs(pred[y_name] - r[y_name]) / r[y_name] / len(reports)
+    return err
+
+
+def get_config(model, reports, kernel, variant, q_size):
+    """ Resources and fmax of a config: from its report if built, otherwise predicted. """
+    for build in BUILDS:
+        for r in reports:
+            if (r['kernel'], r['variant'], r['q_size'], r['build']) == (kernel, variant, q_size,
+                                                                        build):
+                return dict(r, source='report')
+
+    kernel_builds = [r['build'] for r in reports if r['kernel'] == kernel]
+    build = next((b for b in BUILDS if b in kernel_builds), BUILDS[0])
+    return dict(predict(model, kernel, variant, build, q_size), kernel=kernel, variant=variant,
+                q_size=q_size, build=build, source='model')
+
+
+def get_measured_workloads(kernel, bin_type):
+    """
+    {workload : {(variant, q_size) : time}} from the run_exp_all_percentages.py results. Simulation
+    results are cycles (the time is cycles / fmax), hardware results are ms.
+    """
+    workloads = {}
+    try:
+        with open(f'{EXP_DATA_DIR}/{kernel}_{bin_type}.csv', 'r') as f:
+            reader = csv.reader(f)
+            header = [col.strip(')') for col in next(reader)]
+            for row in reader:
+                if not row[0].isdigit():
+                    continue
+                times = {}
+                for col, val in zip(header[1:], row[1:]):
+                    match = re.fullmatch(rf'({"|".join(VARIANTS)})(?:_(\d+)qsize)?', col)
+                    if match:
+                        times[(match.group(1), int(match.group(2) or 0))] = float(val)
+                workloads[f'percentage_wait {row[0]}'] = times
+    except FileNotFoundError:
+        pass
+    return workloads
+
+
+def get_predicted_workload(analyzer_args):
+    """ {(variant, q_size) : cycles} predicted by dependency_analyzer for one input. """
+    if not os.path.exists(ANALYZER_BIN):
+        os.system('cd dependency_analyzer && make')
+    stdout = subprocess.run([ANALYZER_BIN] + analyzer_args, capture_output=True,
+                            text=True).stdout
+
+    cycles = {}
+    for line in stdout[stdout.find('Predicted:'):].splitlines():
+        cols = line.split()
+        if len(cols) == 5 and cols[0] == 'static':
+            cycles[('static', 0)] = float(cols[3])
+        elif len(cols) == 5 and cols[0].isdigit():
+            variant = 'dynamic' if cols[1] == 'yes' else 'dynamic_no_forward'
+            cycles[(variant, int(cols[0]))] = float(cols[3])
+    return cycles
+
+
+def pareto_front(configs):
+    """ The configs no other config beats in time and every resource. """
+    def dominates(a, b):
+        keys = ['time'] + RESOURCES
+        return all(a[k] <= b[k] for k in keys) and any(a[k] < b[k] for k in keys)
+    return [c for c in configs if not any(dominates(o, c) for o in configs)]
+
+
+def tune(model, reports, kernel, workload, times, is_cycles):
+    configs = []
+    for (variant, q_size), t in times.items():
+        config = get_config(model, reports, kernel, variant, q_size)
+        # Cycles run at the config's fmax (MHz), so time in ms.
+        config['time'] = t / (1000.0 / config['period']) / 1000 if is_cycles else t
+        configs.append(config)
+
+    front = pareto_front(configs)
+    print(f'\n{kernel}, {workload}:')
+    print(f'{"config":>26} {"time":>12} {"ALUTs":>8} {"REGs":>8} {"RAMs":>6} {"fmax":>6}'
+          f'  resources  pareto')
+    for c in sorted(configs, key=lambda c: c['time']):
+        name = c['variant'] + (f'_{c["q_size"]}qsize' if c['variant'] != 'static' else '')
+        print(f'{name:>26} {c["time"]:>12.4g} {int(c["aluts"]):>8} {int(c["regs"]):>8} '
+              f'{int(c["rams"]):>6} {int(1000 / c["period"]):>6}  {c["source"]:>9}  '
+              f'{"*" if c in front else ""}')
+    return configs, front
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2 or sys.argv[1] not in ['sim', 'hw', 'model']:
+        exit("ERROR: No source of cycle counts provided\n"
+             "USAGE: python3 auto_tune.py [sim, hw]\n"
+             "       python3 auto_tune.py model KERNEL [dependency_analyzer args]\n")
+    source = sys.argv[1]
+
+    reports = get_reports()
+    model = fit_model(reports)
+    err = model_error(model, reports)
+    print(f'Resource model fitted to {len(reports)} reports, mean abs error: ' +
+          ', '.join(f'{y_name} {100 * e:.1f}%' for y_name, e in err.items()))
+
+    if source == 'model':
+        kernel = sys.argv[2]
+        kernels = {kernel : {' '.join(sys.argv[3:]) : get_predicted_workload(sys.argv[3:])}}
+    else:
+        kernels = {kernel : get_measured_workloads(kernel, source) for kernel in KERNELS}
+
+    # The fastest dynamic Q_SIZE per kernel, by the geometric mean of its times over workloads.
+    best_q_sizes = {}
+    for kernel, workloads in kernels.items():
+        if not workloads:
+            print(f'\n{kernel}: no {source} results in {EXP_DATA_DIR}')
+            continue
+
+        Path(f'{EXP_DATA_DIR}').mkdir(parents=True, exist_ok=True)
+        res_file = f'{EXP_DATA_DIR}/{kernel}_pareto_{source}.csv'
+        log_times = {}
+        with open(res_file, 'w') as f:
+            writer = csv.writer(f)
+            writer.writerow(['workload', 'variant', 'q_size', 'time', 'ALUTs', 'REGs', 'RAMs',
+                             'fmax (MHz)', 'resources', 'pareto'])
+            for workload, times in workloads.items():
+                configs, front = tune(model, reports, kernel, workload, times,
+                                      is_cycles=(source != 'hw'))
+                for c in configs:
+                    writer.writerow([workload, c['variant'], c['q_size'], c['time'],
+                                     int(c['aluts']), int(c['regs']), int(c['rams']),
+                                     int(1000 / c['period']), c['source'], int(c in front)])
+                    if c['variant'] == 'dynamic':
+                        log_times.setdefault(c['q_size'], []).append(math.log(c['time']))
+
+        if log_times:
+            best_q_sizes[kernel] = min(log_times, key=lambda q: sum(log_times[q]) /
+                                                                len(log_times[q]))
+        print(f'\nResults saved to {res_file}')
+
+    print(f'\nBEST_Q_SIZES_DYNAMIC = {best_q_sizes}')
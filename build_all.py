@@ -11,6 +11,9 @@ KERNELS = [
 ]
 
 Q_SIZES = [2, 4, 8, 16]
+# The sweeps run_exp.py and gen_resource_table.py read. auto_tune.py suggests per-kernel ones.
+Q_SIZES_DYNAMIC = Q_SIZES
+Q_SIZES_DYNAMIC_NO_FORWARD = Q_SIZES
 
 
 def build_make_string(target='fpga_sim', kernel='dynamic', q_size=2):
@@ -13,6 +13,8 @@
 #include "kernel_dynamic.hpp"
 #endif
 
+#include "benchmark_harness.hpp"
+
 using namespace sycl;
 
 template <typename T>
@@ -43,40 +45,12 @@ bool tryParse(std::string& input, uint& output) {
     return true;
 }
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 int main(int argc, char *argv[]) {
-  // Create device selector for the device of your interest.
-#if FPGA_EMULATOR
-  // DPC++ extension: FPGA emulator selector on systems without FPGA card.
-  ext::intel::fpga_emulator_selector d_selector;
-#elif FPGA
-  // DPC++ extension: FPGA selector on systems with FPGA card.
-  ext::intel::fpga_selector d_selector;
-#elif GPU
-  gpu_selector d_selector;
-#else
-  // The default device selector will select the most performant device.
-  default_selector d_selector;
-#endif
+  BenchmarkHarness harness("delaunay-triangulation", argc, argv);
 
-  try {    
-    // Enable profiling.
-    property_list properties{property::queue::enable_profiling()};
-    queue q(d_selector, exception_handler, properties);
-    queue q2(d_selector, exception_handler, properties);
+  try {
+    queue q = harness.make_queue();
+    queue q2 = harness.make_queue();
 
     std::string input;
     uint x;
@@ -101,19 +75,12 @@ int main(int argc, char *argv[]) {
 
     init_data(points);
 
-    auto start = std::chrono::steady_clock::now();
-    double kernel_time = 0;
-
-    kernel_time = delaunay_triang_kernel<float>(q, points, d);
+    // The kernel does not update its inputs, nothing to reset between runs.
+    harness.run(num_points, []() {}, [&]() { return delaunay_triang_kernel<float>(q, points, d); });
 
     // Wait for all work to finish.
     q.wait();
-    
-    std::cout << "\nKernel time (ms): " << kernel_time << "\n";
-
-    auto stop = std::chrono::steady_clock::now();
-    double total_time = (std::chrono::duration<double> (stop - start)).count() * 1000.0;
-    // std::cout << "Total time (ms): " << total_time << "\n";
+    harness.report();
   } catch (exception const &e) {
     std::cout << "An exception was caught.\n";
     std::terminate();
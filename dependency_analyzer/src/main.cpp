@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "dependency_distance.hpp"
+#include "store_queue_trace.hpp"
+#include "../../histogram/src/tables.hpp"
+
+// The QUEUE_SIZEs predicted (the ones swept by store_queue_model).
+using AnalyzerQueueSizes = std::integer_sequence<int, 1, 2, 4, 8, 16, 32, 64>;
+using Distance = DependencyDistance<64>;
+
+enum data_distribution { ALL_WAIT, NO_WAIT, PERCENTAGE_WAIT };
+
+// The hist[feature[i]] += weight[i] streams of histogram/src/main.cpp, generated on the fly: load i
+// has tag i, store i has tag i+1.
+void analyze_histogram(Distance &dist, const int64_t array_size, const data_distribution distr,
+                       const int percentage) {
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0, 100);
+  auto dice = std::bind (distribution, generator);
+
+  int feature_prev = 0;
+  for (int64_t i = 0; i < array_size; i++) {
+    int feature;
+    if (distr == data_distribution::ALL_WAIT)
+      feature = (array_size >= 4) ? random_indx_1024[i % 1024] : i % array_size;
+    else if (distr == data_distribution::NO_WAIT)
+      feature = i;
+    else
+      feature = (dice() <= percentage) ? feature_prev : i;
+    feature_prev = feature;
+
+    dist.load(feature);
+    dist.store(feature, i + 1);
+  }
+}
+
+// The streams of a trace recorded with make TRACE=1, merged into program order: a store goes
+// before every load with the same or a larger tag.
+bool analyze_trace(Distance &dist, const char *filename) {
+  StoreQueueTraceMap trace(filename);
+  if (!trace.is_valid()) {
+    std::cout << "Cannot read StoreQueue trace " << filename << "\n";
+    return false;
+  }
+  const int num_ld_ports = trace.num_ld_ports();
+  const int num_ports = num_ld_ports + trace.num_st_ports();
+  std::vector<int64_t> i_req(num_ports, 0);
+
+  // The next request of port p.
+  auto next = [&](const int p) { return trace.reqs(p)[i_req[p]]; };
+
+  while (true) {
+    int ld_port = -1, st_port = -1;
+    for (int p = 0; p < num_ports; ++p) {
+      auto &min_port = (p >= num_ld_ports) ? st_port : ld_port;
+      if (i_req[p] < trace.num_reqs(p) && (min_port < 0 || next(p).tag < next(min_port).tag))
+        min_port = p;
+    }
+    if (ld_port < 0 && st_port < 0)
+      break;
+
+    const bool is_store = (st_port >= 0 && (ld_port < 0 || next(st_port).tag <= next(ld_port).tag));
+    const int p = is_store ? st_port : ld_port;
+    const auto req = next(p);
+    i_req[p]++;
+    if (is_store)
+      dist.store(req.idx, req.tag);
+    else
+      dist.load(req.idx);
+  }
+  return true;
+}
+
+template <int Q_SIZE, bool IS_FORWARDING_Q>
+void print_prediction(const Distance &dist, const double static_ii, const int64_t num_iters) {
+  const double ii = PredictDynamicII<Q_SIZE, IS_FORWARDING_Q>(dist);
+  std::cout << std::setw(8) << Q_SIZE << std::setw(12) << (IS_FORWARDING_Q ? "yes" : "no")
+            << std::setw(10) << std::fixed << std::setprecision(2) << ii << std::setw(16)
+            << int64_t(ii * num_iters) << std::setw(10) << static_ii / ii << "\n";
+}
+
+template <int... Qs>
+void print_predictions(std::integer_sequence<int, Qs...>, const Distance &dist) {
+  // One iteration per load, or per store if the loads are fewer.
+  const int64_t num_iters = std::max(dist.num_loads(), dist.num_stores());
+  const double static_ii = PredictStaticII();
+
+  std::cout << "\nPredicted:\n";
+  std::cout << std::setw(8) << "Q_SIZE" << std::setw(12) << "forwarding" << std::setw(10) << "II"
+            << std::setw(16) << "cycles" << std::setw(10) << "speedup" << "\n";
+  std::cout << std::setw(8) << "static" << std::setw(12) << "-" << std::setw(10) << std::fixed
+            << std::setprecision(2) << static_ii << std::setw(16) << int64_t(static_ii * num_iters)
+            << std::setw(10) << 1.0 << "\n";
+  (print_prediction<Qs, true>(dist, static_ii, num_iters), ...);
+  (print_prediction<Qs, false>(dist, static_ii, num_iters), ...);
+}
+
+int main(int argc, char *argv[]) {
+  Distance dist;
+
+  if (argc > 1 && !isdigit(argv[1][0])) {
+    // A trace file instead of an ARRAY_SIZE.
+    if (!analyze_trace(dist, argv[1]))
+      return 1;
+    std::cout << argv[1] << "\n";
+  } else {
+    // Get A_SIZE and data distribution from args.
+    // defaults
+    int64_t ARRAY_SIZE = 1000000;
+    auto DATA_DISTR = data_distribution::ALL_WAIT;
+    int PERCENTAGE = 5;
+    try {
+      if (argc > 1) {
+        ARRAY_SIZE = atoll(argv[1]);
+      }
+      if (argc > 2) {
+        DATA_DISTR = data_distribution(atoi(argv[2]));
+      }
+      if (argc > 3) {
+        PERCENTAGE = int(atoi(argv[3]));
+        if (PERCENTAGE < 0 || PERCENTAGE > 100) throw std::invalid_argument("Invalid percentage.");
+      }
+    } catch (std::exception const &e) {
+      std::cout << "Incorrect argv.\nUsage:\n";
+      std::cout << "  ./dependency_analyzer [ARRAY_SIZE] [data_distribution (0/1/2)] "
+                   "[PERCENTAGE]\n";
+      std::cout << "    0 - all_wait, 1 - no_wait, 2 - PERCENTAGE wait\n";
+      std::cout << "  ./dependency_analyzer TRACE_FILE\n";
+      std::terminate();
+    }
+
+    analyze_histogram(dist, ARRAY_SIZE, DATA_DISTR, PERCENTAGE);
+    std::cout << "histogram, ARRAY_SIZE " << ARRAY_SIZE << ", data_distribution " << DATA_DISTR
+              << "\n";
+  }
+
+  dist.print();
+  print_predictions(AnalyzerQueueSizes{}, dist);
+
+  return 0;
+}
@@ -17,9 +17,17 @@ using namespace fpga_tools;
   #define Q_SIZE 8
 #endif
 
+/// The StoreQueue of the kernel: Q_SIZE entries, with or without forwarding.
+template <bool FORWARDING>
+struct StoreQueueConfig : StoreQueueDefaults {
+  static constexpr int kQueueSize = Q_SIZE;
+  static constexpr bool kForwarding = FORWARDING;
+};
+
 
 double get_tanh_kernel(queue &q, std::vector<int> &h_A, const std::vector<int> h_addr_in,
-                       const std::vector<int> h_addr_out) {
+                       const std::vector<int> h_addr_out, 
+                       StoreQueueStats *h_storeq_stats = nullptr) {
 #if dynamic_no_forward_sched
   constexpr bool IS_FORWARDING_Q = false;
   std::cout << "Dynamic (no forward) HLS\n";
@@ -41,11 +49,13 @@ double get_tanh_kernel(queue &q, std::vector<int> &h_A, const std::vector<int> h
   using end_storeq_signal_pipe = pipe<class end_storeq_signal_pipe_class, int>;
 
   constexpr int kNumLdPipes = 1;
+  constexpr int kNumStPipes = 1;
   using idx_ld_pipes = PipeArray<class idx_ld_pipe_class, pair_t, 64, kNumLdPipes>;
   using val_ld_pipes = PipeArray<class val_ld_pipe_class, int, 64, kNumLdPipes>;
-  using idx_st_pipe = pipe<class idx_st_pipe_class, pair_t, 64>;
-  using val_st_pipe = pipe<class val_st_pipe_class, int, 64>;
+  using idx_st_pipes = PipeArray<class idx_st_pipe_class, pair_t, 64, kNumStPipes>;
+  using val_st_pipes = PipeArray<class val_st_pipe_class, int, 64, kNumStPipes>;
 
+  auto storeq_trace = StoreQueueTraceAlloc(q, kNumLdPipes, kNumStPipes, array_size);
   q.submit([&](handler &hnd) {
     hnd.single_task<class LoadIdxSt>([=]() [[intel::kernel_args_restrict]] {
       int tag = 0;
@@ -53,15 +63,20 @@ double get_tanh_kernel(queue &q, std::vector<int> &h_A, const std::vector<int> h
         int ld_i = addr_in[i];
         int st_i = addr_out[i];
         idx_ld_pipes::PipeAt<0>::write({ld_i, tag});
+        StoreQueueTraceLoad(storeq_trace, 0, {ld_i, tag});
         tag++;
-        idx_st_pipe::write({st_i, tag});
+        idx_st_pipes::PipeAt<0>::write({st_i, tag});
+        StoreQueueTraceStore(storeq_trace, 0, {st_i, tag});
       }
     });
   });
 
 
-  StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipe, val_st_pipe, 
-             end_storeq_signal_pipe, Q_SIZE> (q, device_ptr<int>(A));
+  auto storeq_stats = StoreQueueStatsAlloc(q);
+  auto storeqEvent = 
+      StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipes, val_st_pipes, kNumStPipes,
+                 end_storeq_signal_pipe, StoreQueueConfig<IS_FORWARDING_Q>>
+                     (q, device_ptr<int>(A), storeq_stats);
 
 
   auto event = q.submit([&](handler &hnd) {
@@ -79,7 +94,7 @@ double get_tanh_kernel(queue &q, std::vector<int> &h_A, const std::vector<int> h
           result = result_out_pipe::read();
         }
 
-        val_st_pipe::write(result); // A[addr_out[i]] = result;
+        val_st_pipes::PipeAt<0>::write(result); // A[addr_out[i]] = result;
         total_req_stores++;
       }
 
@@ -173,8 +188,11 @@ double get_tanh_kernel(queue &q, std::vector<int> &h_A, const std::vector<int> h
   });
 
   event.wait();
+  storeqEvent.wait();
   q.copy(A, h_A.data(), h_A.size()).wait();
 
+  StoreQueueStatsCopyAndFree(storeq_stats, h_storeq_stats, q);
+  StoreQueueTraceSaveAndFree(storeq_trace, "get_tanh.sqtrace", q);
   sycl::free(A, q);
   sycl::free(addr_in, q);
   sycl::free(addr_out, q);
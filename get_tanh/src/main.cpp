@@ -14,6 +14,8 @@
   #include "kernel_dynamic.hpp"
 #endif
 
+#include "benchmark_harness.hpp"
+
 using namespace sycl;
 
 enum data_distribution { ALL_WAIT, NO_WAIT, PERCENTAGE_WAIT };
@@ -123,21 +125,9 @@ void get_tanh_cpu(std::vector<int> &A, const std::vector<int> addr_in,
   }
 }
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 int main(int argc, char *argv[]) {
+  BenchmarkHarness harness("get_tanh", argc, argv);
+
   // Get A_SIZE and forward/no-forward from args.
   // defaulats
   uint ARRAY_SIZE = 64;
@@ -161,21 +151,13 @@ int main(int argc, char *argv[]) {
     std::cout << "  ./hist [ARRAY_SIZE] [data_distribution (0/1/2)] [PERCENTAGE (only for "
                  "data_distr 2)]\n";
     std::cout << "    0 - all_wait, 1 - no_wait, 2 - PERCENTAGE wait\n";
+    std::cout << "    [--warmup=N] [--repeats=N] [--json=FILE] (see benchmark_harness.hpp)\n";
     std::terminate();
   }
 
-#if FPGA_EMULATOR
-  ext::intel::fpga_emulator_selector d_selector;
-#elif FPGA
-  ext::intel::fpga_selector d_selector;
-#else
-  default_selector d_selector;
-#endif
   try {
-    // Enable profiling.
-    property_list properties{property::queue::enable_profiling()};
-    queue q(d_selector, exception_handler, properties);
-    queue q2(d_selector, exception_handler, properties);
+    queue q = harness.make_queue();
+    queue q2 = harness.make_queue();
 
     // Print out the device information used for the kernel code.
     std::cout << "Running on device: " << q.get_device().get_info<info::device::name>() << "\n";
@@ -193,28 +175,33 @@ int main(int argc, char *argv[]) {
     std::vector<int> A_cpu(ARRAY_SIZE);
     std::copy(A.begin(), A.end(), A_cpu.begin());
 
-    auto start = std::chrono::steady_clock::now();
-    double kernel_time = 0;
-
-    kernel_time = get_tanh_kernel(q, A, addr_in, addr_out);
+    // The kernel updates A in place, every run starts from the initial one (still in A_cpu).
+    auto reset = [&]() { std::copy(A_cpu.begin(), A_cpu.end(), A.begin()); };
+    #if STOREQ_STATS && !static_sched
+      StoreQueueStats storeq_stats;
+      harness.run(ARRAY_SIZE, reset,
+                  [&]() { return get_tanh_kernel(q, A, addr_in, addr_out, &storeq_stats); });
+    #else
+      harness.run(ARRAY_SIZE, reset, [&]() { return get_tanh_kernel(q, A, addr_in, addr_out); });
+    #endif
 
     // Wait for all work to finish.
     q.wait();
 
-    std::cout << "\nKernel time (ms): " << kernel_time << "\n";
+    #if STOREQ_STATS && !static_sched
+      storeq_stats.print();
+    #endif
 
     get_tanh_cpu(A_cpu, addr_in, addr_out);
-    if (std::equal(A.begin(), A.end(), A_cpu.begin())) {
+    const bool is_passed = std::equal(A.begin(), A.end(), A_cpu.begin());
+    if (is_passed) {
       std::cout << "Passed\n";
     } else {
       std::cout << "Failed";
       std::cout << " sum(A_fpga) = " << std::accumulate(A.begin(), A.end(), 0) << "\n";
       std::cout << " sum(A_cpu) = " << std::accumulate(A_cpu.begin(), A_cpu.end(), 0) << "\n";
     }
-
-    auto stop = std::chrono::steady_clock::now();
-    double total_time = (std::chrono::duration<double>(stop - start)).count() * 1000.0;
-    // std::cout << "Total time (ms): " << total_time << "\n";
+    harness.report(is_passed);
   } catch (exception const &e) {
     std::cout << "An exception was caught.\n";
     std::terminate();
@@ -12,6 +12,8 @@
 #include "kernel_dynamic.hpp"
 #endif
 
+#include "benchmark_harness.hpp"
+
 using TYPE = float;
 
 using namespace sycl;
@@ -26,39 +28,11 @@ void init_data(std::vector<T> &a, std::vector<T> &r, const uint N, const uint M)
   }
 }
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 int main(int argc, char *argv[]) {
-  // Create device selector for the device of your interest.
-#if FPGA_EMULATOR
-  // DPC++ extension: FPGA emulator selector on systems without FPGA card.
-  ext::intel::fpga_emulator_selector d_selector;
-#elif FPGA
-  // DPC++ extension: FPGA selector on systems with FPGA card.
-  ext::intel::fpga_selector d_selector;
-#elif GPU
-  gpu_selector d_selector;
-#else
-  // The default device selector will select the most performant device.
-  default_selector d_selector;
-#endif
+  BenchmarkHarness harness("gram-schmidt", argc, argv);
 
   try {
-    // Enable profiling.
-    property_list properties{property::queue::enable_profiling()};
-    queue q(d_selector, exception_handler, properties);
+    queue q = harness.make_queue();
 
     // Print out the device information used for the kernel code.
     std::cout << "Running on device: " << q.get_device().get_info<info::device::name>() << "\n";
@@ -74,20 +48,17 @@ int main(int argc, char *argv[]) {
 
     init_data(a,r, N, M);
 
-    auto start = std::chrono::steady_clock::now();
-    double kernel_time = 0;
-
-    kernel_time = gram_schmidt_kernel<TYPE>(q, a, r, N, M);
+    // The kernel updates a and r in place, every run starts from the initial values.
+    const auto a_init = a;
+    const auto r_init = r;
+    harness.run(N * M, [&]() { a = a_init; r = r_init; },
+                [&]() { return gram_schmidt_kernel<TYPE>(q, a, r, N, M); });
 
     // Wait for all work to finish.
     // q.wait();
 
-    std::cout << "\nKernel time (ms): " << kernel_time << "\n";
     std::cout << "r[0] = " << r[0] << "\n";
-
-    auto stop = std::chrono::steady_clock::now();
-    double total_time = (std::chrono::duration<double>(stop - start)).count() * 1000.0;
-    // std::cout << "Total time (ms): " << total_time << "\n";
+    harness.report();
   } catch (exception const &e) {
     std::cout << "An exception was caught.\n";
     std::terminate();
@@ -0,0 +1,23 @@
+import json
+
+
+# Timed runs (and untimed warmup runs before them) of a hardware binary, see
+# include/benchmark_harness.hpp. The median kernel time is recorded.
+REPEATS = 5
+WARMUP = 1
+
+
+def harness_args(bin, json_file):
+    """ Simulation cycle counts are deterministic and emulation times meaningless: run once. """
+    if 'fpga_sim' in bin or 'fpga_emu' in bin:
+        return f'--json={json_file}'
+    return f'--warmup={WARMUP} --repeats={REPEATS} --json={json_file}'
+
+
+def get_harness_summary(json_file):
+    """ The JSON summary written by the benchmark harness, None if the binary did not write one. """
+    try:
+        with open(json_file, 'r') as f:
+            return json.load(f)
+    except (FileNotFoundError, json.JSONDecodeError):
+        return None
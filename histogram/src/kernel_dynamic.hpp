@@ -3,6 +3,7 @@
 #include "CL/sycl/properties/accessor_properties.hpp"
 #include <CL/sycl.hpp>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 
 #include <sycl/ext/intel/fpga_extensions.hpp>
@@ -16,79 +17,185 @@ using namespace sycl;
   #define Q_SIZE 8
 #endif
 
+// Batches of the dynamic_persistent variant, which keeps one StoreQueue resident across them.
+#ifndef NUM_BATCHES
+  #define NUM_BATCHES 4
+#endif
+
+// Retire stores once a StoreAck kernel has written them with a burst-coalesced LSU (1), instead 
+// of after the fixed latency of the pipelined LSU (0).
+#ifndef Q_RETIRE_ACK
+  #define Q_RETIRE_ACK 0
+#endif
+
+// Stores kept dirty per port, so a repeated hist bin is written once (0 writes every store). 
+// Needs forwarding.
+#ifndef Q_WRITE_COMBINE
+  #define Q_WRITE_COMBINE 0
+#endif
+
+// Keep hist in an on-chip array of Q_ONCHIP_DEPTH >= ARRAY_SIZE elements (0 uses global memory).
+#ifndef Q_ONCHIP_DEPTH
+  #define Q_ONCHIP_DEPTH 0
+#endif
+
+// Banks of the StoreQueue, each with Q_SIZE entries per store port, interleaved by hist bin.
+#ifndef Q_NUM_BANKS
+  #define Q_NUM_BANKS 1
+#endif
+
+// Loads in flight per port in the StoreQueueLoad kernel (0 loads in the StoreQueue kernel).
+#ifndef Q_LOAD_BUFFER_SIZE
+  #define Q_LOAD_BUFFER_SIZE 0
+#endif
+
+// Entries of the StoreQueue load cache, which holds recently stored hist bins (0 disables it).
+#ifndef Q_LOAD_CACHE_SIZE
+  #define Q_LOAD_CACHE_SIZE 0
+#endif
+
 constexpr int STORE_Q_SIZE = Q_SIZE;
 
+/// The StoreQueue of the kernel: Q_SIZE entries, with or without forwarding, and either launched
+/// once per run or resident across the batches. Tags step by 1 per element, and the requests in 
+/// flight fit in the 64-deep idx/val pipes and the queue, so 12-bit tags with a wide margin for 
+/// the real pipe depths replace 32-bit ones. The other knobs are set by the Q_* macros above.
+template <bool FORWARDING, bool PERSISTENT>
+struct StoreQueueConfig : StoreQueueDefaults {
+  static constexpr int kQueueSize = Q_SIZE;
+  static constexpr bool kForwarding = FORWARDING;
+  static constexpr StoreRetire kRetire = Q_RETIRE_ACK ? StoreRetire::Ack : StoreRetire::Countdown;
+  using StoreLSU = std::conditional_t<Q_RETIRE_ACK, BurstCoalescedLSU, PipelinedLSU>;
+  static constexpr int kWriteCombine = Q_WRITE_COMBINE;
+  using MemoryBackend = 
+      std::conditional_t<(Q_ONCHIP_DEPTH > 0), OnchipMemory<Q_ONCHIP_DEPTH>, GlobalMemory>;
+  static constexpr int kNumBanks = Q_NUM_BANKS;
+  static constexpr int kLoadBufferSize = Q_LOAD_BUFFER_SIZE;
+  static constexpr int kLoadCacheSize = Q_LOAD_CACHE_SIZE;
+  static constexpr int kMaxTagDistance = 1024;
+  static constexpr bool kPersistent = PERSISTENT;
+};
+
 
 double histogram_kernel(queue &q, const std::vector<int> &h_feature, const std::vector<int> &h_weight,
-                        std::vector<int> &h_hist) {
+                        std::vector<int> &h_hist, StoreQueueStats *h_storeq_stats = nullptr) {
 #if dynamic_no_forward_sched
   constexpr bool IS_FORWARDING_Q = false;
+  constexpr bool IS_PERSISTENT_Q = false;
   std::cout << "Dynamic (no forward) HLS\n";
+#elif dynamic_persistent_sched
+  constexpr bool IS_FORWARDING_Q = true;
+  constexpr bool IS_PERSISTENT_Q = true;
+  std::cout << "Dynamic (persistent StoreQueue, " << NUM_BATCHES << " batches) HLS\n";
 #else
   constexpr bool IS_FORWARDING_Q = true;
+  constexpr bool IS_PERSISTENT_Q = false;
   std::cout << "Dynamic HLS\n";
 #endif
 
   const int array_size = h_feature.size();
+  if (Q_ONCHIP_DEPTH > 0 && array_size > Q_ONCHIP_DEPTH)
+    throw std::invalid_argument("ARRAY_SIZE does not fit the on-chip array of Q_ONCHIP_DEPTH.");
 
   int* feature = toDevice(h_feature, q);
   int* weight = toDevice(h_weight, q);
   int* hist = toDevice(h_hist, q);
 
   constexpr int kNumLdPipes = 1;
+  constexpr int kNumStPipes = 1;
   using idx_ld_pipes = PipeArray<class feature_load_pipe_class, pair_t, 64, kNumLdPipes>;
   using val_ld_pipes = PipeArray<class hist_load_pipe_class, int, 64, kNumLdPipes>;
   using weight_load_pipe = pipe<class weight_load_pipe_class, int, 64>;
-  using idx_st_pipe = pipe<class feature_store_pipe_class, pair_t, 64>;
-  using val_st_pipe = pipe<class hist_store_pipe_class, int, 64>;
+  using idx_st_pipes = PipeArray<class feature_store_pipe_class, pair_t, 64, kNumStPipes>;
+  using val_st_pipes = PipeArray<class hist_store_pipe_class, int, 64, kNumStPipes>;
 
   using end_storeq_signal_pipe = pipe<class end_storeq_signal_pipe_class, int>;
 
   constexpr int kNumStoreOps = 1;
+  // The persistent variant launches the StoreQueue once and sends the elements as batches of 
+  // consecutive ones. Tags continue across batches, so all batches are sent at once, and the run 
+  // ends when the queue has finished the last one (its StoreQueueBatchDone event).
+  const int num_batches = IS_PERSISTENT_Q ? std::max(std::min(NUM_BATCHES, array_size), 1) : 1;
+  const int batch_size = (array_size + num_batches - 1) / num_batches;
+
+  auto storeq_stats = StoreQueueStatsAlloc(q);
+  auto storeq_event = 
+      StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipes, val_st_pipes, kNumStPipes,
+                 end_storeq_signal_pipe, StoreQueueConfig<IS_FORWARDING_Q, IS_PERSISTENT_Q>>
+                     (q, device_ptr<int>(hist), storeq_stats, array_size);
+
   // q.submit([&](handler &hnd) {
   //   hnd.single_task<class LoadFeature>([=]() [[intel::kernel_args_restrict]] {
   //     for (int i = 0; i < array_size; ++i) 
   //       idx_ld_pipes::PipeAt<0>::write({int(feature[i]), i*kNumStoreOps + 0});
   //   });
   // });
-  q.submit([&](handler &hnd) {
-    hnd.single_task<class LoadFeature2>([=]() [[intel::kernel_args_restrict]] {
-      for (int i = 0; i < array_size; ++i) {
-        idx_ld_pipes::PipeAt<0>::write({int(feature[i]), i*kNumStoreOps + 0});
-        idx_st_pipe::write({int(feature[i]), i*kNumStoreOps + 1});
-      }
+  auto storeq_trace = StoreQueueTraceAlloc(q, kNumLdPipes, kNumStPipes, array_size);
+  // The kernels of a batch (and its StoreQueueBatchDone) run after those of the previous one, so 
+  // the requests and end signals reach the queue in batch order.
+  event first_event, last_event;
+  std::vector<event> producer_deps, compute_deps, batch_done_deps;
+  for (int batch = 0; batch < num_batches; ++batch) {
+    const int batch_begin = std::min(batch * batch_size, array_size);
+    const int batch_end = std::min(batch_begin + batch_size, array_size);
+
+    auto producer_event = q.submit([&](handler &hnd) {
+      hnd.depends_on(producer_deps);
+      hnd.single_task<class LoadFeature2>([=]() [[intel::kernel_args_restrict]] {
+        for (int i = batch_begin; i < batch_end; ++i) {
+          pair_t ld_req = {int(feature[i]), i*kNumStoreOps + 0};
+          pair_t st_req = {int(feature[i]), i*kNumStoreOps + 1};
+          idx_ld_pipes::PipeAt<0>::write(ld_req);
+          idx_st_pipes::PipeAt<0>::write(st_req);
+          StoreQueueTraceLoad(storeq_trace, 0, ld_req);
+          StoreQueueTraceStore(storeq_trace, 0, st_req);
+        }
+      });
     });
-  });
 
-  auto event = q.submit([&](handler &hnd) {
-    hnd.single_task<class Compute>([=]() [[intel::kernel_args_restrict]] {
-      int total_req_stores = 0;
-      for (int i = 0; i < array_size; ++i) {
-        int wt = weight[i];
-        int hist = val_ld_pipes::PipeAt<0>::read();
+    last_event = q.submit([&](handler &hnd) {
+      hnd.depends_on(compute_deps);
+      hnd.single_task<class Compute>([=]() [[intel::kernel_args_restrict]] {
+        int total_req_stores = 0;
+        for (int i = batch_begin; i < batch_end; ++i) {
+          int wt = weight[i];
+          int hist = val_ld_pipes::PipeAt<0>::read();
 
-        auto new_hist = hist + wt;
+          auto new_hist = hist + wt;
 
-        val_st_pipe::write(new_hist);
-        total_req_stores++;
-      }
+          val_st_pipes::PipeAt<0>::write(new_hist);
+          total_req_stores++;
+        }
 
-      end_storeq_signal_pipe::write(total_req_stores);
+        end_storeq_signal_pipe::write(total_req_stores);
+      });
     });
-  });
-
-  StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipe, val_st_pipe, 
-             end_storeq_signal_pipe, Q_SIZE> (q, device_ptr<int>(hist)).wait();
-
-  event.wait();
+    if (batch == 0)
+      first_event = last_event;
+    producer_deps = {producer_event};
+    compute_deps = {last_event};
+    if (IS_PERSISTENT_Q)
+      batch_done_deps = {StoreQueueBatchDone(q, batch_done_deps)};
+  }
+
+  // The queue only shuts down after the last batch, which ends the timed run.
+  if (IS_PERSISTENT_Q) {
+    last_event = batch_done_deps.back();
+    last_event.wait();
+    StoreQueueShutdown<end_storeq_signal_pipe>(q);
+  }
+  storeq_event.wait();
+  last_event.wait();
   q.copy(hist, h_hist.data(), h_hist.size()).wait();
 
+  StoreQueueStatsCopyAndFree(storeq_stats, h_storeq_stats, q);
+  StoreQueueTraceSaveAndFree(storeq_trace, "histogram.sqtrace", q);
   sycl::free(hist, q);
   sycl::free(feature, q);
   sycl::free(weight, q);
 
-  auto start = event.get_profiling_info<info::event_profiling::command_start>();
-  auto end = event.get_profiling_info<info::event_profiling::command_end>();
+  auto start = first_event.get_profiling_info<info::event_profiling::command_start>();
+  auto end = last_event.get_profiling_info<info::event_profiling::command_end>();
   double time_in_ms = static_cast<double>(end - start) / 1000000;
 
   return time_in_ms;
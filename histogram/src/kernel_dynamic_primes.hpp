@@ -17,6 +17,9 @@
   Altough mathematically pleasing, this idea is not practical because the primes become too large 
   to quickly. One could decrease the maximum number of in-flight stores to n such that 
   the COMPOSITE_PRIME is only a factor of n primes, but even this still results in large numbers.
+
+  The StoreQueue in include/store_queue.hpp implements the same check with a counting Bloom filter
+  (see the kBloomSize knob of its Config), which has bounded counter widths.
 */
 
 
@@ -0,0 +1,98 @@
+#include "CL/sycl/access/access.hpp"
+#include "CL/sycl/builtins.hpp"
+#include "CL/sycl/properties/accessor_properties.hpp"
+#include <CL/sycl.hpp>
+#include <iostream>
+#include <vector>
+
+#include <sycl/ext/intel/fpga_extensions.hpp>
+
+#include "store_queue.hpp"
+#include "memory_utils.hpp"
+
+using namespace sycl;
+
+#ifndef Q_SIZE
+  #define Q_SIZE 8
+#endif
+
+constexpr int STORE_Q_SIZE = Q_SIZE;
+
+/// The StoreQueue of the kernel: Q_SIZE entries, every store an update.
+struct StoreQueueConfig : StoreQueueDefaults {
+  static constexpr int kQueueSize = Q_SIZE;
+  static constexpr bool kUpdate = true;
+};
+
+
+// hist[feature[i]] += weight[i] as a StoreQueue update: every update has a base load of 
+// hist[feature[i]]. If an older update of the idx is still in the queue, then the base load returns
+// 0 without waiting for it, and the queue adds that update's value to the weight.
+double histogram_kernel(queue &q, const std::vector<int> &h_feature, const std::vector<int> &h_weight,
+                        std::vector<int> &h_hist, StoreQueueStats *h_storeq_stats = nullptr) {
+  std::cout << "Dynamic (update) HLS\n";
+
+  const int array_size = h_feature.size();
+
+  int* feature = toDevice(h_feature, q);
+  int* weight = toDevice(h_weight, q);
+  int* hist = toDevice(h_hist, q);
+
+  constexpr int kNumLdPipes = 1;
+  constexpr int kNumStPipes = 1;
+  using idx_ld_pipes = PipeArray<class feature_load_pipe_class, pair_t, 64, kNumLdPipes>;
+  using val_ld_pipes = PipeArray<class hist_load_pipe_class, int, 64, kNumLdPipes>;
+  using idx_st_pipes = PipeArray<class feature_store_pipe_class, pair_t, 64, kNumStPipes>;
+  using val_st_pipes = PipeArray<class hist_store_pipe_class, int, 64, kNumStPipes>;
+
+  using end_storeq_signal_pipe = pipe<class end_storeq_signal_pipe_class, int>;
+
+  auto storeq_trace = StoreQueueTraceAlloc(q, kNumLdPipes, kNumStPipes, array_size);
+  q.submit([&](handler &hnd) {
+    hnd.single_task<class LoadFeature>([=]() [[intel::kernel_args_restrict]] {
+      for (int i = 0; i < array_size; ++i) {
+        pair_t ld_req = {int(feature[i]), 2*i};
+        pair_t st_req = {int(feature[i]), 2*i + 1};
+        idx_ld_pipes::PipeAt<0>::write(ld_req);
+        idx_st_pipes::PipeAt<0>::write(st_req);
+        StoreQueueTraceLoad(storeq_trace, 0, ld_req);
+        StoreQueueTraceStore(storeq_trace, 0, st_req);
+      }
+    });
+  });
+
+  auto event = q.submit([&](handler &hnd) {
+    hnd.single_task<class Compute>([=]() [[intel::kernel_args_restrict]] {
+      int total_req_stores = 0;
+      for (int i = 0; i < array_size; ++i) {
+        int wt = weight[i];
+        int hist = val_ld_pipes::PipeAt<0>::read();
+
+        val_st_pipes::PipeAt<0>::write(hist + wt);
+        total_req_stores++;
+      }
+
+      end_storeq_signal_pipe::write(total_req_stores);
+    });
+  });
+
+  auto storeq_stats = StoreQueueStatsAlloc(q);
+  StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipes, val_st_pipes, kNumStPipes,
+             end_storeq_signal_pipe, StoreQueueConfig>
+                 (q, device_ptr<int>(hist), storeq_stats).wait();
+
+  event.wait();
+  q.copy(hist, h_hist.data(), h_hist.size()).wait();
+
+  StoreQueueStatsCopyAndFree(storeq_stats, h_storeq_stats, q);
+  StoreQueueTraceSaveAndFree(storeq_trace, "histogram_update.sqtrace", q);
+  sycl::free(hist, q);
+  sycl::free(feature, q);
+  sycl::free(weight, q);
+
+  auto start = event.get_profiling_info<info::event_profiling::command_start>();
+  auto end = event.get_profiling_info<info::event_profiling::command_end>();
+  double time_in_ms = static_cast<double>(end - start) / 1000000;
+
+  return time_in_ms;
+}
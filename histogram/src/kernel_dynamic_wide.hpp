@@ -0,0 +1,136 @@
+#include "CL/sycl/access/access.hpp"
+#include "CL/sycl/builtins.hpp"
+#include "CL/sycl/properties/accessor_properties.hpp"
+#include <CL/sycl.hpp>
+#include <iostream>
+#include <vector>
+
+#include <sycl/ext/intel/fpga_extensions.hpp>
+
+#include "store_queue.hpp"
+#include "memory_utils.hpp"
+
+using namespace sycl;
+
+#ifndef Q_SIZE
+  #define Q_SIZE 8
+#endif
+
+// Elements moved by one read/write of the StoreQueue pipes.
+#ifndef Q_WIDTH
+  #define Q_WIDTH 2
+#endif
+
+constexpr int STORE_Q_SIZE = Q_SIZE;
+
+/// The StoreQueue of the kernel: Q_SIZE entries per lane, with Q_WIDTH-wide pipes.
+struct StoreQueueConfig : StoreQueueDefaults {
+  static constexpr int kQueueSize = Q_SIZE;
+  static constexpr int kWidth = Q_WIDTH;
+};
+
+
+// Q_WIDTH elements per group. Group g sends the loads of its elements with tags 2*W*g + j and the
+// stores with tags 2*W*g + W + j, so a load does not wait for the stores of its own group. The
+// compute kernel forwards those itself, from the youngest older lane with the same bin. The unused
+// lanes of the last group carry idx -1.
+double histogram_kernel(queue &q, const std::vector<int> &h_feature, const std::vector<int> &h_weight,
+                        std::vector<int> &h_hist, StoreQueueStats *h_storeq_stats = nullptr) {
+  std::cout << "Dynamic (" << Q_WIDTH << "-wide pipes) HLS\n";
+
+  constexpr int W = Q_WIDTH;
+  const int array_size = h_feature.size();
+  const int num_groups = (array_size + W - 1) / W;
+
+  int* feature = toDevice(h_feature, q);
+  int* weight = toDevice(h_weight, q);
+  int* hist = toDevice(h_hist, q);
+
+  constexpr int kNumLdPipes = 1;
+  constexpr int kNumStPipes = 1;
+  using idx_group_t = group_t<pair_t, W>;
+  using val_group_t = group_t<int, W>;
+  using idx_ld_pipes = PipeArray<class feature_load_pipe_class, idx_group_t, 64, kNumLdPipes>;
+  using val_ld_pipes = PipeArray<class hist_load_pipe_class, val_group_t, 64, kNumLdPipes>;
+  using idx_st_pipes = PipeArray<class feature_store_pipe_class, idx_group_t, 64, kNumStPipes>;
+  using val_st_pipes = PipeArray<class hist_store_pipe_class, val_group_t, 64, kNumStPipes>;
+
+  using end_storeq_signal_pipe = pipe<class end_storeq_signal_pipe_class, int>;
+
+  // Lane j is recorded as port j, as the StoreQueue handles it.
+  auto storeq_trace = StoreQueueTraceAlloc(q, W, W, num_groups);
+  q.submit([&](handler &hnd) {
+    hnd.single_task<class LoadFeature>([=]() [[intel::kernel_args_restrict]] {
+      for (int g = 0; g < num_groups; ++g) {
+        idx_group_t ld_req, st_req;
+        #pragma unroll
+        for (int j = 0; j < W; ++j) {
+          const int i = g * W + j;
+          const bool is_valid = (i < array_size);
+          const int idx = is_valid ? int(feature[i]) : -1;
+          ld_req.data[j] = {idx, 2 * W * g + j};
+          st_req.data[j] = {idx, 2 * W * g + W + j};
+          ld_req.valid[j] = st_req.valid[j] = is_valid;
+          if (is_valid) {
+            StoreQueueTraceLoad(storeq_trace, j, ld_req.data[j]);
+            StoreQueueTraceStore(storeq_trace, j, st_req.data[j]);
+          }
+        }
+        idx_ld_pipes::PipeAt<0>::write(ld_req);
+        idx_st_pipes::PipeAt<0>::write(st_req);
+      }
+    });
+  });
+
+  auto event = q.submit([&](handler &hnd) {
+    hnd.single_task<class Compute>([=]() [[intel::kernel_args_restrict]] {
+      int total_req_stores = 0;
+      for (int g = 0; g < num_groups; ++g) {
+        val_group_t hist_group = val_ld_pipes::PipeAt<0>::read();
+        val_group_t new_hist_group;
+        int bin[W];
+        #pragma unroll
+        for (int j = 0; j < W; ++j) {
+          const int i = g * W + j;
+          const bool is_valid = (i < array_size);
+          bin[j] = is_valid ? int(feature[i]) : -1;
+
+          int hist = hist_group.data[j];
+          #pragma unroll
+          for (int j_older = 0; j_older < j; ++j_older) {
+            if (bin[j_older] == bin[j])
+              hist = new_hist_group.data[j_older];
+          }
+
+          new_hist_group.data[j] = hist + (is_valid ? weight[i] : 0);
+          new_hist_group.valid[j] = is_valid;
+          total_req_stores += is_valid;
+        }
+
+        val_st_pipes::PipeAt<0>::write(new_hist_group);
+      }
+
+      end_storeq_signal_pipe::write(total_req_stores);
+    });
+  });
+
+  auto storeq_stats = StoreQueueStatsAlloc(q);
+  StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipes, val_st_pipes, kNumStPipes,
+             end_storeq_signal_pipe, StoreQueueConfig>
+                 (q, device_ptr<int>(hist), storeq_stats).wait();
+
+  event.wait();
+  q.copy(hist, h_hist.data(), h_hist.size()).wait();
+
+  StoreQueueStatsCopyAndFree(storeq_stats, h_storeq_stats, q);
+  StoreQueueTraceSaveAndFree(storeq_trace, "histogram_wide.sqtrace", q);
+  sycl::free(hist, q);
+  sycl::free(feature, q);
+  sycl::free(weight, q);
+
+  auto start = event.get_profiling_info<info::event_profiling::command_start>();
+  auto end = event.get_profiling_info<info::event_profiling::command_end>();
+  double time_in_ms = static_cast<double>(end - start) / 1000000;
+
+  return time_in_ms;
+}
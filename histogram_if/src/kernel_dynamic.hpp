@@ -18,8 +18,16 @@ using namespace fpga_tools;
   #define Q_SIZE 8
 #endif
 
+/// The StoreQueue of the kernel: Q_SIZE entries, with or without forwarding.
+template <bool FORWARDING>
+struct StoreQueueConfig : StoreQueueDefaults {
+  static constexpr int kQueueSize = Q_SIZE;
+  static constexpr bool kForwarding = FORWARDING;
+};
+
 double histogram_if_kernel(queue &q, const std::vector<int> &h_feature, 
-                           const std::vector<int> &h_weight, std::vector<int> &h_hist) {
+                           const std::vector<int> &h_weight, std::vector<int> &h_hist,
+                           StoreQueueStats *h_storeq_stats = nullptr) {
 
 #if dynamic_no_forward_sched
   constexpr bool IS_FORWARDING_Q = false;
@@ -36,10 +44,11 @@ double histogram_if_kernel(queue &q, const std::vector<int> &h_feature,
   int* hist = toDevice(h_hist, q);
 
   constexpr int kNumLdPipes = 1;
+  constexpr int kNumStPipes = 1;
   using idx_ld_pipes = PipeArray<class feature_load_pipe_class, pair_t, 64, kNumLdPipes>;
   using val_ld_pipes = PipeArray<class hist_load_pipe_class, int, 64, kNumLdPipes>;
-  using val_st_pipe = pipe<class hist_store_pipe_class, int, 64>;
-  using idx_st_pipe = pipe<class feature_store_pipe_class, pair_t, 64>;
+  using val_st_pipes = PipeArray<class hist_store_pipe_class, int, 64, kNumStPipes>;
+  using idx_st_pipes = PipeArray<class feature_store_pipe_class, pair_t, 64, kNumStPipes>;
 
   using weight_load_pipe = pipe<class weight_load_pipe_class, int, 64>;
   using weight_load_2_pipe = pipe<class weight_load_2_pipe_class, int, 64>;
@@ -50,6 +59,7 @@ double histogram_if_kernel(queue &q, const std::vector<int> &h_feature,
   using calc_predicate_pipe = pipe<class calc_predicate_pipe_class, bool, 64>;
   using end_storeq_signal_pipe = pipe<class end_signal_pipe_class, int>;
 
+  auto storeq_trace = StoreQueueTraceAlloc(q, kNumLdPipes, kNumStPipes, array_size);
   q.submit([&](handler &hnd) {
     hnd.single_task<class LoadFeature2>([=]() [[intel::kernel_args_restrict]] {
       int tag = 0;
@@ -57,15 +67,20 @@ double histogram_if_kernel(queue &q, const std::vector<int> &h_feature,
         auto wt = weight[i];
         if (wt > 0) {
           idx_ld_pipes::PipeAt<0>::write({int(feature[i]), tag});
+          StoreQueueTraceLoad(storeq_trace, 0, {int(feature[i]), tag});
           tag++;
-          idx_st_pipe::write({int(feature[i]), tag});
+          idx_st_pipes::PipeAt<0>::write({int(feature[i]), tag});
+          StoreQueueTraceStore(storeq_trace, 0, {int(feature[i]), tag});
         }
       }
     });
   });
 
-  StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipe, val_st_pipe, 
-             end_storeq_signal_pipe, Q_SIZE> (q, device_ptr<int>(hist));
+  auto storeq_stats = StoreQueueStatsAlloc(q);
+  auto storeqEvent = 
+      StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipes, val_st_pipes, kNumStPipes,
+                 end_storeq_signal_pipe, StoreQueueConfig<IS_FORWARDING_Q>>
+                     (q, device_ptr<int>(hist), storeq_stats);
 
   // q.submit([&](handler &hnd) {
   //   hnd.single_task<class ActualCalc>([=]() [[intel::kernel_args_restrict]] {
@@ -91,7 +106,7 @@ double histogram_if_kernel(queue &q, const std::vector<int> &h_feature,
           // int new_hist = weight_load_2_pipe::read();
           int new_hist = hist + wt;
 
-          val_st_pipe::write(new_hist);
+          val_st_pipes::PipeAt<0>::write(new_hist);
           total_req_stores++;
         }
         
@@ -103,8 +118,11 @@ double histogram_if_kernel(queue &q, const std::vector<int> &h_feature,
   });
 
   event.wait();
+  storeqEvent.wait();
   q.copy(hist, h_hist.data(), h_hist.size()).wait();
 
+  StoreQueueStatsCopyAndFree(storeq_stats, h_storeq_stats, q);
+  StoreQueueTraceSaveAndFree(storeq_trace, "histogram_if.sqtrace", q);
   sycl::free(hist, q);
   sycl::free(feature, q);
   sycl::free(weight, q);
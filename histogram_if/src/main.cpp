@@ -10,11 +10,14 @@
 
 #if static_sched
   #include "kernel_static.hpp"
+#elif dynamic_cancel_sched
+  #include "kernel_dynamic_cancel.hpp"
 #else
   #include "kernel_dynamic.hpp"
 #endif
 
 #include "tables.hpp"
+#include "benchmark_harness.hpp"
 
 using namespace sycl;
 
@@ -54,21 +57,9 @@ void histogram_if_cpu(const std::vector<int> &feature, const std::vector<int> &w
   }
 }
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 int main(int argc, char *argv[]) {
+  BenchmarkHarness harness("histogram_if", argc, argv);
+
   // Get A_SIZE and forward/no-forward from args.
   // defaulats
   int ARRAY_SIZE = 64;
@@ -90,21 +81,13 @@ int main(int argc, char *argv[]) {
     std::cout << "Incorrect argv.\nUsage:\n";
     std::cout << "  ./hist [ARRAY_SIZE] [data_distribution (0/1/2)] [PERCENTAGE (only for data_distr 2)]\n";
     std::cout << "    0 - all_wait, 1 - no_wait, 2 - PERCENTAGE wait\n";
+    std::cout << "    [--warmup=N] [--repeats=N] [--json=FILE] (see benchmark_harness.hpp)\n";
     std::terminate();
   }
 
-#if FPGA_EMULATOR
-  ext::intel::fpga_emulator_selector d_selector;
-#elif FPGA
-  ext::intel::fpga_selector d_selector;
-#else
-  default_selector d_selector;
-#endif
   try {
-    // Enable profiling.
-    property_list properties{property::queue::enable_profiling()};
-    queue q(d_selector, exception_handler, properties);
-    queue q2(d_selector, exception_handler, properties);
+    queue q = harness.make_queue();
+    queue q2 = harness.make_queue();
 
     // Print out the device information used for the kernel code.
     std::cout << "Running on device: " << q.get_device().get_info<info::device::name>() << "\n";
@@ -122,32 +105,37 @@ int main(int argc, char *argv[]) {
     std::vector<int> hist_cpu(ARRAY_SIZE);
     std::copy(hist.begin(), hist.end(), hist_cpu.begin());
 
-    auto start = std::chrono::steady_clock::now();
-    double kernel_time = 0;
-
+    // The kernel updates hist in place, every run starts from the initial one (still in hist_cpu).
+    auto reset = [&]() { std::copy(hist_cpu.begin(), hist_cpu.end(), hist.begin()); };
     #if (NO_FORWARD == 1)
-      kernel_time = histogram_if_kernel_no_forward(q, feature, weight, hist);
+      harness.run(ARRAY_SIZE, reset,
+                  [&]() { return histogram_if_kernel_no_forward(q, feature, weight, hist); });
+    #elif STOREQ_STATS && !static_sched
+      StoreQueueStats storeq_stats;
+      harness.run(ARRAY_SIZE, reset,
+                  [&]() { return histogram_if_kernel(q, feature, weight, hist, &storeq_stats); });
     #else
-      kernel_time = histogram_if_kernel(q, feature, weight, hist);
+      harness.run(ARRAY_SIZE, reset,
+                  [&]() { return histogram_if_kernel(q, feature, weight, hist); });
     #endif
 
     // Wait for all work to finish.
     q.wait();
 
-    std::cout << "\nKernel time (ms): " << kernel_time << "\n";
+    #if STOREQ_STATS && !static_sched && (NO_FORWARD != 1)
+      storeq_stats.print();
+    #endif
 
     histogram_if_cpu(feature, weight, hist_cpu, ARRAY_SIZE);
-    if (std::equal(hist.begin(), hist.end(), hist_cpu.begin())) {
+    const bool is_passed = std::equal(hist.begin(), hist.end(), hist_cpu.begin());
+    if (is_passed) {
       std::cout << "Passed\n";
     }
     else {
       std::cout << "Failed";
       std::cout << " sum(hist) = " << std::accumulate(hist.begin(), hist.end(), 0) << "\n";
     }
-
-    auto stop = std::chrono::steady_clock::now();
-    double total_time = (std::chrono::duration<double>(stop - start)).count() * 1000.0;
-    // std::cout << "Total time (ms): " << total_time << "\n";
+    harness.report(is_passed);
   } catch (exception const &e) {
     std::cout << "An exception was caught.\n";
     std::terminate();
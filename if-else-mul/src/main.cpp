@@ -12,6 +12,8 @@
 #include "kernel_dynamic.hpp"
 #endif
 
+#include "benchmark_harness.hpp"
+
 using TYPE = float;
 
 using namespace sycl;
@@ -28,39 +30,11 @@ void init_data(std::vector<int> &wet, std::vector<T> &B, const int array_size) {
   }
 }
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 int main(int argc, char *argv[]) {
-  // Create device selector for the device of your interest.
-#if FPGA_EMULATOR
-  // DPC++ extension: FPGA emulator selector on systems without FPGA card.
-  ext::intel::fpga_emulator_selector d_selector;
-#elif FPGA
-  // DPC++ extension: FPGA selector on systems with FPGA card.
-  ext::intel::fpga_selector d_selector;
-#elif GPU
-  gpu_selector d_selector;
-#else
-  // The default device selector will select the most performant device.
-  default_selector d_selector;
-#endif
+  BenchmarkHarness harness("if-else-mul", argc, argv);
 
   try {
-    // Enable profiling.
-    property_list properties{property::queue::enable_profiling()};
-    queue q(d_selector, exception_handler, properties);
+    queue q = harness.make_queue();
 
     // Print out the device information used for the kernel code.
     std::cout << "Running on device: " << q.get_device().get_info<info::device::name>() << "\n";
@@ -74,20 +48,16 @@ int main(int argc, char *argv[]) {
 
     init_data(wet, B, ARRAY_SIZE);
 
-    auto start = std::chrono::steady_clock::now();
-    double kernel_time = 0;
-
-    kernel_time = if_else_mul_kernel<float>(q, wet, B, ARRAY_SIZE);
+    // The kernel updates B in place, every run starts from the initial values.
+    const auto B_init = B;
+    harness.run(ARRAY_SIZE, [&]() { B = B_init; },
+                [&]() { return if_else_mul_kernel<float>(q, wet, B, ARRAY_SIZE); });
 
     // Wait for all work to finish.
     // q.wait();
 
-    std::cout << "\nKernel time (ms): " << kernel_time << "\n";
     std::cout << "B[0] = " << B[0] << "\n";
-
-    auto stop = std::chrono::steady_clock::now();
-    double total_time = (std::chrono::duration<double>(stop - start)).count() * 1000.0;
-    // std::cout << "Total time (ms): " << total_time << "\n";
+    harness.report();
   } catch (exception const &e) {
     std::cout << "An exception was caught.\n";
     std::terminate();
@@ -0,0 +1,247 @@
+/*
+Host-side harness shared by the benchmark mains.
+
+Creates the profiling queue on the device of the build, runs a benchmark kernel a configurable
+number of warmup and timed repetitions, and reports min/median/p95/p99 of the kernel time (from
+event profiling) and of the end-to-end time (device allocation, copies and kernel, host clock),
+plus the throughput in elements/s. The summary can be written as JSON for the run_exp scripts.
+
+The harness options are given before or after the positional args of a benchmark:
+  --warmup=N    untimed runs before the timed ones (default 0)
+  --repeats=N   timed runs (default 1)
+  --json=FILE   write the summary as JSON to FILE ("-" for stdout)
+*/
+
+#ifndef __BENCHMARK_HARNESS_HPP__
+#define __BENCHMARK_HARNESS_HPP__
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sycl/ext/intel/fpga_extensions.hpp>
+
+/// Device selector of the build: FPGA emulator, FPGA (hardware or simulator), GPU or default.
+#if FPGA_EMULATOR
+using benchmark_selector_t = sycl::ext::intel::fpga_emulator_selector;
+#elif FPGA
+using benchmark_selector_t = sycl::ext::intel::fpga_selector;
+#elif GPU
+using benchmark_selector_t = sycl::gpu_selector;
+#else
+using benchmark_selector_t = sycl::default_selector;
+#endif
+
+/// Exception handler for asynchronous SYCL exceptions.
+inline void BenchmarkExceptionHandler(sycl::exception_list e_list) {
+  for (std::exception_ptr const &e : e_list) {
+    try {
+      std::rethrow_exception(e);
+    } catch (std::exception const &e) {
+#if _DEBUG
+      std::cout << "Failure" << std::endl;
+#endif
+      std::terminate();
+    }
+  }
+}
+
+/// Order statistics of a set of time samples (ms). Percentiles are nearest-rank.
+struct BenchmarkSummary {
+  double min;
+  double median;
+  double p95;
+  double p99;
+  double mean;
+
+  static BenchmarkSummary Of(std::vector<double> samples) {
+    if (samples.empty())
+      return {0, 0, 0, 0, 0};
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&](const double p) {
+      const auto rank = size_t(std::ceil(p / 100.0 * samples.size()));
+      return samples[std::max(rank, size_t(1)) - 1];
+    };
+    double sum = 0;
+    for (auto s : samples)
+      sum += s;
+    return {samples.front(), percentile(50), percentile(95), percentile(99),
+            sum / samples.size()};
+  }
+};
+
+class BenchmarkHarness {
+ public:
+  /// Takes the harness options out of argv, so that the positional args of the benchmark keep
+  /// their index. Exits on a malformed option.
+  BenchmarkHarness(const char *name, int &argc, char *argv[]) : name_(name) {
+    int num_args = 1;
+    for (int i = 1; i < argc; ++i) {
+      if (!parse_option(argv[i])) {
+        args_.push_back(argv[i]);
+        argv[num_args++] = argv[i];
+      }
+    }
+    argc = num_args;
+    argv[argc] = nullptr;
+  }
+
+  /// A profiling queue on the device of the build. Benchmarks with several queues call it again.
+  sycl::queue make_queue() const {
+    benchmark_selector_t d_selector;
+    sycl::property_list properties{sycl::property::queue::enable_profiling()};
+    return sycl::queue(d_selector, BenchmarkExceptionHandler, properties);
+  }
+
+  /// Runs kernel (returning its kernel time in ms) warmup + repeats times. reset restores the
+  /// inputs the kernel updates in place before every run, and is not timed. The outputs of the
+  /// last run are left for verification. Prints the kernel time line run_exp used to scrape (the
+  /// median) and the percentiles when repeating.
+  template <typename ResetF, typename KernelF>
+  void run(const int64_t num_elements, ResetF reset, KernelF kernel) {
+    num_elements_ = num_elements;
+    kernel_times_.clear();
+    total_times_.clear();
+
+    for (int i = 0; i < warmup_ + repeats_; ++i) {
+      reset();
+      auto start = std::chrono::steady_clock::now();
+      const double kernel_time = kernel();
+      auto stop = std::chrono::steady_clock::now();
+      if (i < warmup_)
+        continue;
+      kernel_times_.push_back(kernel_time);
+      total_times_.push_back(std::chrono::duration<double>(stop - start).count() * 1000.0);
+    }
+
+    const auto kernel_summary = BenchmarkSummary::Of(kernel_times_);
+    const auto total_summary = BenchmarkSummary::Of(total_times_);
+    std::cout << "\nKernel time (ms): " << kernel_summary.median << "\n";
+    if (repeats_ > 1) {
+      print_summary("Kernel time", kernel_summary);
+      print_summary("Total time", total_summary);
+      std::cout << "Throughput (elements/s): " << throughput(kernel_summary) << "\n";
+    }
+  }
+
+  /// Writes the JSON summary of the last run(), if --json was given.
+  void report(const bool is_passed) const { report_json(is_passed ? "true" : "false"); }
+  /// The same, for benchmarks without a reference check ("passed" is null).
+  void report() const { report_json("null"); }
+
+  int warmup() const { return warmup_; }
+  int repeats() const { return repeats_; }
+
+ private:
+  void report_json(const char *passed) const {
+    if (json_file_.empty())
+      return;
+
+    if (json_file_ == "-") {
+      write_json(std::cout, passed);
+    } else {
+      std::ofstream f(json_file_);
+      write_json(f, passed);
+      if (!f)
+        std::cout << "Cannot write " << json_file_ << "\n";
+    }
+  }
+
+  bool parse_option(const char *arg) {
+    auto value_of = [&](const char *option) -> const char * {
+      const size_t len = std::strlen(option);
+      return (std::strncmp(arg, option, len) == 0) ? arg + len : nullptr;
+    };
+
+    if (auto val = value_of("--warmup=")) {
+      warmup_ = parse_count(arg, val, 0);
+    } else if (auto val = value_of("--repeats=")) {
+      repeats_ = parse_count(arg, val, 1);
+    } else if (auto val = value_of("--json=")) {
+      json_file_ = val;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  static int parse_count(const char *arg, const char *val, const int min) {
+    char *end;
+    const long count = std::strtol(val, &end, 10);
+    if (*val == '\0' || *end != '\0' || count < min) {
+      std::cout << "Invalid harness option " << arg << " (at least " << min << ")\n";
+      std::exit(1);
+    }
+    return int(count);
+  }
+
+  double throughput(const BenchmarkSummary &kernel_summary) const {
+    return (kernel_summary.median > 0) ? num_elements_ / (kernel_summary.median / 1000.0) : 0;
+  }
+
+  static void print_summary(const char *what, const BenchmarkSummary &s) {
+    std::cout << what << " (ms) min/median/p95/p99: " << s.min << " / " << s.median << " / "
+              << s.p95 << " / " << s.p99 << "\n";
+  }
+
+  static std::string json_string(const std::string &str) {
+    std::string quoted = "\"";
+    for (char c : str) {
+      if (c == '"' || c == '\\')
+        quoted += '\\';
+      quoted += c;
+    }
+    return quoted + "\"";
+  }
+
+  static void write_json_times(std::ostream &os, const char *key,
+                               const std::vector<double> &times) {
+    const auto s = BenchmarkSummary::Of(times);
+    os << "  " << json_string(key) << ": {\"min\": " << s.min << ", \"median\": " << s.median
+       << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99 << ", \"mean\": " << s.mean
+       << ", \"samples\": [";
+    for (size_t i = 0; i < times.size(); ++i)
+      os << (i > 0 ? ", " : "") << times[i];
+    os << "]},\n";
+  }
+
+  void write_json(std::ostream &os, const char *passed) const {
+    const auto precision = os.precision(10);
+    os << "{\n";
+    os << "  \"benchmark\": " << json_string(name_) << ",\n";
+    os << "  \"args\": [";
+    for (size_t i = 0; i < args_.size(); ++i)
+      os << (i > 0 ? ", " : "") << json_string(args_[i]);
+    os << "],\n";
+    os << "  \"warmup\": " << warmup_ << ",\n";
+    os << "  \"repeats\": " << repeats_ << ",\n";
+    os << "  \"num_elements\": " << num_elements_ << ",\n";
+    write_json_times(os, "kernel_time_ms", kernel_times_);
+    write_json_times(os, "total_time_ms", total_times_);
+    os << "  \"throughput_elements_per_s\": " << throughput(BenchmarkSummary::Of(kernel_times_))
+       << ",\n";
+    os << "  \"passed\": " << passed << "\n";
+    os << "}\n";
+    os.precision(precision);
+  }
+
+  std::string name_;
+  std::vector<std::string> args_;
+  int warmup_ = 0;
+  int repeats_ = 1;
+  std::string json_file_;
+
+  int64_t num_elements_ = 0;
+  std::vector<double> kernel_times_;
+  std::vector<double> total_times_;
+};  // class BenchmarkHarness
+
+#endif
@@ -0,0 +1,152 @@
+/*
+Single-pass RAW dependency-distance analysis of {idx, tag} request streams.
+
+Counts, for every load, how many store tag steps back the youngest store to the same idx is (its
+dependency distance), and predicts from that histogram the II of the static kernel and of a
+StoreQueue of every QUEUE_SIZE. Memory is bounded by the longest distance tracked, so streams of
+hundreds of millions of requests can be analysed on the fly, before any FPGA compile.
+*/
+
+#ifndef __DEPENDENCY_DISTANCE_HPP__
+#define __DEPENDENCY_DISTANCE_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "store_queue_model.hpp"
+
+/// Histogram of dependency distances up to MAX_DISTANCE. Requests must be given in program order
+/// (a store before every load with the same or a larger tag). A load that depends on the stores
+/// of the previous tag step has distance 1. Loads without a store to their idx in the last
+/// MAX_DISTANCE steps are counted as far.
+template <int MAX_DISTANCE = 64, int MAX_ST_PORTS = 2>
+class DependencyDistance {
+  static_assert(MAX_DISTANCE > 0 && MAX_ST_PORTS > 0);
+
+ public:
+  void store(const int idx, const int tag) {
+    if (num_stores_ == 0 || tag != last_store_tag_) {
+      step_++;
+      last_store_tag_ = tag;
+    }
+    store_idx_[next_store_] = idx;
+    store_step_[next_store_] = step_;
+    next_store_ = (next_store_ + 1) % kWindowSize;
+    num_stores_++;
+  }
+
+  void load(const int idx) {
+    // The youngest older store to idx within the window (a branchless scan, vectorized). Steps
+    // are compared modulo 2^32.
+    uint32_t min_steps_back = MAX_DISTANCE;
+    for (int i = 0; i < kWindowSize; ++i) {
+      const uint32_t steps_back = step_ - store_step_[i];
+      const bool is_match = (store_idx_[i] == idx && steps_back < MAX_DISTANCE);
+      min_steps_back = std::min(min_steps_back, is_match ? steps_back : MAX_DISTANCE);
+    }
+
+    if (min_steps_back < MAX_DISTANCE)
+      count_[min_steps_back + 1]++;
+    else
+      num_far_++;
+    num_loads_++;
+  }
+
+  int64_t num_loads() const { return num_loads_; }
+  int64_t num_stores() const { return num_stores_; }
+  /// Loads with dependency distance d, 1 <= d <= MAX_DISTANCE.
+  int64_t count(const int d) const { return count_[d]; }
+  int64_t num_far() const { return num_far_; }
+
+  void print() const {
+    std::cout << "Dependency distance (store tag steps), " << num_loads_ << " loads, "
+              << num_stores_ << " stores:\n";
+    for (int lo = 1; lo <= MAX_DISTANCE; lo *= 2) {
+      const int hi = std::min(2 * lo - 1, MAX_DISTANCE);
+      int64_t num = 0;
+      for (int d = lo; d <= hi; ++d)
+        num += count_[d];
+      std::cout << std::setw(12) << (lo == hi ? std::to_string(lo) :
+                                     std::to_string(lo) + "-" + std::to_string(hi))
+                << std::setw(14) << num << std::setw(9) << std::fixed << std::setprecision(2)
+                << 100.0 * num / std::max(num_loads_, int64_t(1)) << " %\n";
+    }
+    std::cout << std::setw(12) << ("> " + std::to_string(MAX_DISTANCE)) << std::setw(14)
+              << num_far_ << std::setw(9) << 100.0 * num_far_ / std::max(num_loads_, int64_t(1))
+              << " %\n";
+  }
+
+ private:
+  static constexpr int kWindowSize = MAX_DISTANCE * MAX_ST_PORTS;
+
+  // The last kWindowSize stores, and the tag step of each (the initial ones are out of range).
+  int store_idx_[kWindowSize] = {};
+  uint32_t store_step_[kWindowSize] = {};
+  int next_store_ = 0;
+  uint32_t step_ = MAX_DISTANCE;
+  int last_store_tag_ = 0;
+
+  int64_t count_[MAX_DISTANCE + 1] = {};
+  int64_t num_far_ = 0;
+  int64_t num_loads_ = 0;
+  int64_t num_stores_ = 0;
+};  // class DependencyDistance
+
+/// II of the static kernel: the compiler cannot tell the load of an iteration from the store of
+/// the previous one apart, so every iteration waits for the previous store to reach memory.
+inline double PredictStaticII(const StoreQueueModelTiming &timing = {}) {
+  return timing.load_latency + timing.compute_latency + timing.store_latency;
+}
+
+/// Average II of the loop behind a StoreQueue with the given QUEUE_SIZE, FORWARDING, SEARCH_WIDTH
+/// and II, on streams with the dependency histogram dist. The load of iteration i resolves at
+///   t(i) = max(t(i-1) + II,
+///              t(i-1-QUEUE_SIZE) + free_latency,  as the store of i-1 needs a free entry,
+///              t(i-d) + dep_latency)              if it depends on the store d steps back.
+/// dep_latency is the load -> compute -> store value round trip (plus retirement without
+/// FORWARDING), free_latency the round trip plus retirement and the search pipeline. Stores more
+/// than QUEUE_SIZE steps back have left the queue. The recurrence is run on num_samples distances
+/// drawn from dist, so that chains of dependencies are accounted for.
+template <int QUEUE_SIZE, bool FORWARDING = true, int SEARCH_WIDTH = 4, int II = 1,
+          int MAX_DISTANCE, int MAX_ST_PORTS>
+double PredictDynamicII(const DependencyDistance<MAX_DISTANCE, MAX_ST_PORTS> &dist,
+                        const StoreQueueModelTiming &timing = {}, int64_t num_samples = 1 << 20) {
+  constexpr int kNumSearchStages = (QUEUE_SIZE + SEARCH_WIDTH - 1) / SEARCH_WIDTH;
+  constexpr int kMaxDepDistance = std::min(QUEUE_SIZE, MAX_DISTANCE);
+  // Issue, resolve and value acceptance take an iteration each, the queue full check one more.
+  const int64_t round_trip = timing.load_latency + timing.compute_latency + II;
+  const int64_t dep_latency = round_trip + (FORWARDING ? 0 : timing.store_latency + II);
+  const int64_t free_latency = round_trip + timing.store_latency + (kNumSearchStages + 3) * II;
+
+  // Distances that can stall the queue, and all others (as 0).
+  std::vector<double> weights(kMaxDepDistance + 1, 0.0);
+  weights[0] = std::max(dist.num_loads(), int64_t(1));
+  for (int d = 1; d <= kMaxDepDistance; ++d) {
+    weights[d] = dist.count(d);
+    weights[0] -= dist.count(d);
+  }
+  std::default_random_engine generator;
+  std::discrete_distribution<int> distance(weights.begin(), weights.end());
+
+  // Issue times of the last kHistory iterations.
+  constexpr int kHistory = std::max(QUEUE_SIZE + 1, kMaxDepDistance) + 1;
+  int64_t t[kHistory] = {};
+  num_samples = std::max(num_samples, int64_t(kHistory));
+  for (int64_t i = 1; i <= num_samples; ++i) {
+    const int d = distance(generator);
+    int64_t t_i = t[(i - 1) % kHistory] + II;
+    if (i > QUEUE_SIZE + 1)
+      t_i = std::max(t_i, t[(i - 1 - QUEUE_SIZE) % kHistory] + free_latency);
+    if (d > 0 && i > d)
+      t_i = std::max(t_i, t[(i - d) % kHistory] + dep_latency);
+    t[i % kHistory] = t_i;
+  }
+  return double(t[num_samples % kHistory]) / num_samples;
+}
+
+#endif
@@ -15,11 +15,18 @@ Store queue with early execution of loads when all preceding stores have calcula
 
 #include <sycl/ext/intel/fpga_extensions.hpp>
 #include <sycl/ext/intel/ac_types/ac_int.hpp>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <type_traits>
+#include <vector>
 
 #include "pipe_utils.hpp"
 #include "tuple.hpp"
 #include "unrolled_loop.hpp"
 #include "constexpr_math.hpp"
+#include "onchip_memory_with_cache.hpp"
+#include "store_queue_trace.hpp"
 
 
 using namespace sycl;
@@ -40,180 +47,1614 @@ using namespace fpga_tools;
 // a coalesced access. (Use sycl::ext::intel::experimental::lsu<> if want latency control).
 using PipelinedLSU = ext::intel::lsu<>;
 constexpr int kLatencyPipelinedLSU = 7;
-  
-// Forward declaration to avoid name mangling.
-class StoreQueueKernel;
+// Only usable with StoreRetire::Ack, since its store latency is not fixed.
+using BurstCoalescedLSU = ext::intel::lsu<ext::intel::burst_coalesce<true>>;
+
+/// How a committed store entry is retired (freed) from the store queue.
+enum class StoreRetire {
+  /// kLatencyPipelinedLSU iterations after the store was issued. Needs the PipelinedLSU.
+  Countdown,
+  /// Once the StoreAck kernel acknowledges the write. Correct for any LSU and memory latency.
+  Ack
+};
+
+/// Memory backends of the StoreQueue. With GlobalMemory, loads and stores access data directly.
+struct GlobalMemory { 
+  static constexpr int kDepth = 0; 
+  static constexpr int kCacheDepth = 0; 
+};
+/// With OnchipMemory, data[0, data_size) is preloaded into an on-chip array of DEPTH elements and
+/// drained back to data once all stores have retired. The register cache of CACHE_DEPTH entries 
+/// hides the read-after-write latency of the on-chip RAM.
+template <int DEPTH, int CACHE_DEPTH = 4> 
+struct OnchipMemory { 
+  static constexpr int kDepth = DEPTH; 
+  static constexpr int kCacheDepth = CACHE_DEPTH; 
+};
+
+/// Performance counters of a StoreQueue run, written to device memory once the queue finishes. 
+/// Stall counts are summed over all load (store) ports, one per port and iteration.
+struct StoreQueueStats {
+  int64_t num_iterations;
+  int ii;
+  int64_t num_loads_forwarded;
+  int64_t num_loads_from_mem;
+  int64_t num_loads_from_cache;
+  // A load waits for the store idxs that precede it (tag_load > tag_store).
+  int64_t num_stalls_tag;
+  // A load matched a store that is still waiting_for_val (or not retired, without forwarding).
+  int64_t num_stalls_waiting_for_val;
+  // A store idx waits for space in its queue (bank).
+  int64_t num_queue_full;
+
+  void print() const {
+    std::cout << "StoreQueue stats:\n"
+              << "  Iterations: " << num_iterations 
+              << " (>= " << num_iterations * ii << " cycles at II=" << ii << ")\n"
+              << "  Loads forwarded from queue: " << num_loads_forwarded << "\n"
+              << "  Loads served from memory: " << num_loads_from_mem << "\n"
+              << "  Loads served from load cache: " << num_loads_from_cache << "\n"
+              << "  Load stalls, tag_load > tag_store: " << num_stalls_tag << "\n"
+              << "  Load stalls, store waiting_for_val: " << num_stalls_waiting_for_val << "\n"
+              << "  Queue full (store idx stalls): " << num_queue_full << "\n";
+  }
+};
+
+/// The StoreQueue only synthesizes the counters if it is given a StoreQueueStats*. Benchmarks 
+/// compiled with -DSTOREQ_STATS=1 allocate one in device memory, otherwise they pass a nullptr. 
+/// The counters are copied back to the host once the StoreQueue kernel has finished.
+#if STOREQ_STATS
+inline StoreQueueStats *StoreQueueStatsAlloc(queue &q) {
+  return malloc_device<StoreQueueStats>(1, q);
+}
+inline void StoreQueueStatsCopyAndFree(StoreQueueStats *stats, StoreQueueStats *h_stats, 
+                                       queue &q) {
+  if (h_stats)
+    q.memcpy(h_stats, stats, sizeof(StoreQueueStats)).wait();
+  sycl::free(stats, q);
+}
+#else
+inline std::nullptr_t StoreQueueStatsAlloc(queue &q) { return nullptr; }
+inline void StoreQueueStatsCopyAndFree(std::nullptr_t, StoreQueueStats *, queue &) {}
+#endif
+
+// Forward declaration to avoid name mangling. Every StoreQueue in a program needs its own 
+// KernelId (any class declared at namespace scope), so that its kernels get unique names.
+template <typename KernelId> class StoreQueueKernel;
+template <typename KernelId> class StoreAckKernel;
+template <typename KernelId> class StoreQueueShutdownKernel;
+template <typename KernelId, int port> class StoreQueueLoadKernel;
+template <typename KernelId> class StoreQueueBatchDoneKernel;
+template <typename KernelId> class StoreQueueBatchDonePipeClass;
+
+/// A persistent StoreQueue reads one end_signal_pipe value per batch: the number of stores in the
+/// batch, or kStoreQueueShutdown to terminate the kernel.
+constexpr int kStoreQueueShutdown = -1;
+
+/// A persistent StoreQueue writes the number of batches it has finished to this pipe, one value 
+/// per batch. Read by the StoreQueueBatchDone kernels.
+template <typename KernelId>
+using StoreQueueBatchDonePipe = ext::intel::pipe<StoreQueueBatchDonePipeClass<KernelId>, int, 8>;
+
+/// With kEndTokens, the idx of the last request on every ld/st idx pipe port (and on every lane of 
+/// a wide port). The tag of a store port's end token must not be smaller than any load tag.
+constexpr int kStoreQueueEnd = -2;
+
+/// The event of a kernel that completes once a persistent StoreQueue has finished one more batch 
+/// (all its stores are visible in memory). Submit one per batch, each depending on the previous.
+template <typename KernelId = void>
+event StoreQueueBatchDone(queue &q, const std::vector<event> &deps = {}) {
+  return q.submit([&](handler &hnd) {
+    hnd.depends_on(deps);
+    hnd.single_task<StoreQueueBatchDoneKernel<KernelId>>([=]() {
+      StoreQueueBatchDonePipe<KernelId>::read();
+    });
+  });
+}
+
+/// Terminates a persistent StoreQueue once all submitted batches have finished.
+template <typename end_signal_pipe, typename KernelId = void>
+event StoreQueueShutdown(queue &q) {
+  return q.submit([&](handler &hnd) {
+    hnd.single_task<StoreQueueShutdownKernel<KernelId>>([=]() { 
+      end_signal_pipe::write(kStoreQueueShutdown); 
+    });
+  });
+}
 
-/// Used for {idx, tag} pairs.
+/// Used for {idx, tag} pairs. Only the low bits of a tag are used, so tags may wrap around.
 struct pair_t { int first; int second; };
 
-template <typename ld_idx_pipes, typename ld_val_pipes, int num_lds, typename st_idx_pipe,
-          typename st_val_pipe, typename end_signal_pipe, int QUEUE_SIZE = 8, typename value_t>
-event StoreQueue(queue &q, device_ptr<value_t> data) {
+/// WIDTH requests (or values) moved by one read/write of a WIDTH-wide StoreQueue pipe. Unused 
+/// lanes are marked !valid, but an unused {idx, tag} lane must still carry a tag.
+template <typename T, int WIDTH>
+struct group_t { T data[WIDTH]; bool valid[WIDTH]; };
+
+/// The {idx, tag} requests recorded by the address producers of a benchmark compiled with 
+/// -DSTOREQ_TRACE=1, in device memory. Up to max_reqs requests are kept per port. The producer 
+/// kernels capture the trace by value. Otherwise the trace is a nullptr and recording is a no-op.
+struct StoreQueueTrace {
+  int num_ld_ports;
+  int num_st_ports;
+  int64_t max_reqs;
+  // Requests sent on every port (load ports first), and the first max_reqs of them.
+  int64_t *num_reqs;
+  idx_tag_t *reqs;
+};
+
+#if STOREQ_TRACE
+inline StoreQueueTrace StoreQueueTraceAlloc(queue &q, int num_ld_ports, int num_st_ports, 
+                                            int64_t max_reqs) {
+  const int num_ports = num_ld_ports + num_st_ports;
+  StoreQueueTrace trace = {num_ld_ports, num_st_ports, max_reqs, 
+                           malloc_device<int64_t>(num_ports, q), 
+                           malloc_device<idx_tag_t>(num_ports * max_reqs, q)};
+  const std::vector<int64_t> h_num_reqs(num_ports, 0);
+  q.copy(h_num_reqs.data(), trace.num_reqs, num_ports).wait();
+  return trace;
+}
+/// Records a request sent to a load (store) port. Called by the producer kernel next to the pipe 
+/// write, and only by one kernel per port.
+inline void StoreQueueTraceLoad(const StoreQueueTrace &trace, int port, pair_t req) {
+  const int64_t n = trace.num_reqs[port]++;
+  if (n < trace.max_reqs)
+    trace.reqs[port * trace.max_reqs + n] = {req.first, req.second};
+}
+inline void StoreQueueTraceStore(const StoreQueueTrace &trace, int port, pair_t req) {
+  StoreQueueTraceLoad(trace, trace.num_ld_ports + port, req);
+}
+/// Copies the trace back and writes it to filename (once the producer kernels are done).
+inline void StoreQueueTraceSaveAndFree(const StoreQueueTrace &trace, const char *filename, 
+                                       queue &q) {
+  const int num_ports = trace.num_ld_ports + trace.num_st_ports;
+  std::vector<int64_t> h_num_reqs(num_ports);
+  std::vector<idx_tag_t> h_reqs(num_ports * trace.max_reqs);
+  q.copy(trace.num_reqs, h_num_reqs.data(), num_ports).wait();
+  q.copy(trace.reqs, h_reqs.data(), h_reqs.size()).wait();
+
+  std::vector<std::vector<idx_tag_t>> streams[2];
+  for (int p = 0; p < num_ports; ++p) {
+    const idx_tag_t *reqs = h_reqs.data() + p * trace.max_reqs;
+    const int64_t num_reqs = std::min(h_num_reqs[p], trace.max_reqs);
+    if (h_num_reqs[p] > trace.max_reqs)
+      std::cout << "StoreQueue trace: port " << p << " truncated to " << num_reqs << " requests\n";
+    streams[p >= trace.num_ld_ports].emplace_back(reqs, reqs + num_reqs);
+  }
+
+  if (StoreQueueTraceWrite(filename, streams[0], streams[1]))
+    std::cout << "StoreQueue trace written to " << filename << "\n";
+  else
+    std::cout << "StoreQueue trace: cannot write " << filename << "\n";
+
+  sycl::free(trace.reqs, q);
+  sycl::free(trace.num_reqs, q);
+}
+#else
+inline std::nullptr_t StoreQueueTraceAlloc(queue &, int, int, int64_t) { return nullptr; }
+inline void StoreQueueTraceLoad(std::nullptr_t, int, pair_t) {}
+inline void StoreQueueTraceStore(std::nullptr_t, int, pair_t) {}
+inline void StoreQueueTraceSaveAndFree(std::nullptr_t, const char *, queue &) {}
+#endif
+
+/// Base pointers of the arrays (regions) covered by a StoreQueue with kNumRegions > 1.
+template <typename value_t, int NUM_REGIONS>
+struct region_table_t { device_ptr<value_t> base[NUM_REGIONS]; };
+
+/// A store value sent to a StoreQueue with CANCEL. A cancelled store does not write memory.
+template <typename value_t>
+struct store_val_t { value_t val; bool is_cancelled; };
+
+/// With kNumRegions > 1, a request idx holds the region in its top bits and the element idx in 
+/// the low StoreQueueRegionShift bits. The queue then compares (region, idx) pairs as one int.
+template <int NUM_REGIONS>
+constexpr int StoreQueueRegionShift() { return 31 - fpga_tools::CeilLog2(NUM_REGIONS); }
+template <int NUM_REGIONS>
+constexpr int StoreQueueRegionIdx(int region, int idx) {
+  return (region << StoreQueueRegionShift<NUM_REGIONS>()) | idx;
+}
+
+/// The default StoreQueue configuration (the knobs are described at StoreQueue). A configuration
+/// derives from it and only overrides the knobs it changes, e.g.
+///   struct MyConfig : StoreQueueDefaults { static constexpr int kQueueSize = 16; };
+struct StoreQueueDefaults {
+  static constexpr int kQueueSize = 8;
+  static constexpr bool kForwarding = true;
+  static constexpr int kSearchWidth = 4;
+  /// The initiation interval of the main loop of the StoreQueue kernel.
+  static constexpr int kII = 1;
+  static constexpr int kBloomSize = 0;
+  static constexpr StoreRetire kRetire = StoreRetire::Countdown;
+  using StoreLSU = PipelinedLSU;
+  static constexpr int kWriteCombine = 0;
+  using MemoryBackend = GlobalMemory;
+  static constexpr int kNumBanks = 1;
+  static constexpr int kMaxTagDistance = 0;
+  static constexpr bool kPersistent = false;
+  static constexpr int kWidth = 1;
+  static constexpr int kLoadBufferSize = 0;
+  static constexpr int kLoadCacheSize = 0;
+  static constexpr int kNumRegions = 1;
+  static constexpr bool kUpdate = false;
+  static constexpr bool kCancel = false;
+  static constexpr bool kEndTokens = false;
+  using KernelId = void;
+};
+
+/// Loads and stores arrive as {idx, tag} pairs on PipeArrays with num_lds/num_sts ports. A load 
+/// depends on all stores with tag <= its tag. Tags must be strictly increasing on every store 
+/// port, and stores on different ports that share a tag must not write the same idx.
+///
+/// The knobs below are the members of Config (see StoreQueueDefaults).
+///
+/// kMaxTagDistance > 0 keeps tags as narrow ac_ints, compared modulo their width. It must bound 
+/// the distance between the tags of any two requests in flight at once: the stores in the queue, 
+/// the requests buffered in the idx pipes (their real depth, not their min capacity), and the last 
+/// store tag of every port. That depends on the tag step of the kernels (e.g. 2 per iteration with 
+/// tags 2i/2i+1), so it is given by the user. Emulator builds assert the bound. The default of 0 
+/// keeps full 32-bit tags.
+///
+/// With kForwarding == false, a load that matches an in-flight store waits until the store has 
+/// retired and then reads memory. Store values are then not kept in the queue (unless needed for 
+/// kWriteCombine), which trades load latency for area.
+///
+/// kSearchWidth entries per store port are compared against a load in one iteration, so kQueueSize
+/// can grow without changing the II of the main loop (only the load latency). The youngest match 
+/// among them is selected by a tree of depth log2(num_sts * kSearchWidth), so a large kQueueSize 
+/// can also use a wide kSearchWidth (fewer search stages) at a similar fmax.
+///
+/// kBloomSize > 0 adds a counting Bloom filter over the idxs of in-flight stores. A load that 
+/// misses the filter cannot alias any store in the queue and skips the search pipeline, up to the 
+/// youngest load of its port still searching. Every counter is updated once per iteration.
+///
+/// With kRetire == StoreRetire::Ack, stores are written by a StoreAck kernel using StoreLSU. An 
+/// entry stays in the queue (and keeps forwarding its value) until its write is acknowledged.
+/// Pair with the BurstCoalescedLSU to coalesce contiguous store addresses into burst writes.
+///
+/// kWriteCombine > 0 keeps up to kWriteCombine stores per port in the queue after their value 
+/// arrived (dirty). A dirty store is dropped without a memory write once a younger store to the 
+/// same idx has its value. This relies on the in-order compute kernel: all loads older than a 
+/// store have received their value before that store's value is sent.
+///
+/// If stats is a StoreQueueStats* (not nullptr), performance counters are written to it at the end.
+///
+/// MemoryBackend selects where the array lives (GlobalMemory or OnchipMemory<DEPTH>). On-chip 
+/// stores complete in one iteration, so entries retire sooner and a smaller kQueueSize suffices.
+///
+/// kNumBanks > 1 interleaves idxs over banks by their low bits. Every store port then has 
+/// kNumBanks circular buffers of kQueueSize entries, and a load only searches the entries of its 
+/// own bank. Tags stay global, so the number of in-flight stores grows with kNumBanks while the 
+/// search cost stays that of a single kQueueSize buffer.
+///
+/// With kPersistent, the StoreQueue stays resident over a stream of batches on the same data. Each
+/// batch ends with its store count on the end_signal_pipe. Tags continue across batches, so the 
+/// next batch can be sent at once and flows through the queue behind the previous one. Once all 
+/// stores of a batch are visible in memory, the queue starts a new epoch (the store counts and the
+/// load cache restart) and completes one StoreQueueBatchDone event, which the host submits per 
+/// batch. StoreQueueShutdown terminates the kernel after the last batch. A persistent queue has a 
+/// single store port (and kWidth 1): its stores then commit in tag order, so the store count of a 
+/// batch marks its end even while the next batch is already in the queue. With OnchipMemory, data 
+/// is only written back at shutdown. Stats accumulate over all batches.
+///
+/// With kWidth > 1, every pipe carries a group_t of kWidth requests (values) per read, and lane j
+/// of a port is handled as a separate port: its stores get their own queue, and the usual
+/// cross-port checks order the stores of a group. Tags must increase along the lanes of a group
+/// and from group to group. All loads of a group precede its stores, since the compute kernel only
+/// sends the store values once it has received the whole load group.
+///
+/// kLoadBufferSize > 0 moves the memory loads into a StoreQueueLoad kernel per load port. A 
+/// resolved load (forwarded or not) is passed to it through a buffer of kLoadBufferSize entries, 
+/// and the values are returned in tag order. The load port is then free as soon as a load is 
+/// resolved, so independent loads overlap their memory latency.
+///
+/// kLoadCacheSize > 0 adds a cache of memory values, searched by loads that match no store entry.
+/// It holds the values of the latest stores committed to memory (allocated round-robin, updated in 
+/// place for a cached idx), so loads of recently stored idxs skip the round trip to global memory 
+/// after the store has retired. It is only filled from store values held on chip, so the memory 
+/// latency of a load never feeds back into the next lookup.
+///
+/// kNumRegions > 1 lets one queue cover several arrays, given as a region_table_t of base pointers.
+/// Requests then carry StoreQueueRegionIdx(region, idx), and all dependency checks are on the 
+/// (region, idx) pair. The regions must not overlap in memory.
+///
+/// With kUpdate, every store is an update, and every load is the base load of the update with the
+/// next tag (e.g. tags 2i and 2i+1). The compute kernel sends the base load value plus its delta. 
+/// If an older store to the idx is in the queue, then the base load returns value_t() at once, and
+/// the queue adds the value of the youngest such store to the update. That store stays in the 
+/// queue until the update has its value. Otherwise the base load reads memory like any other load.
+/// Repeated updates of an idx then chain through the queue registers instead of a load round trip 
+/// through the compute kernel, and memory is never read on the store path. An update waits until 
+/// every store port has received the stores preceding it. Requires StoreRetire::Countdown.
+///
+/// With kCancel, st_val pipes carry store_val_t, so address producers can send the idx of a 
+/// predicated store before the predicate is known. The compute kernel then sends either the value 
+/// or a cancel token. A cancelled entry takes the value of the youngest older store to its idx in 
+/// the queue (if kForwarding), so loads that matched it still get the right value, and retires 
+/// without writing memory. Without such a store, loads that match it read memory. With kUpdate, a 
+/// cancel token is an update with no delta: its val is the base load value.
+///
+/// With kEndTokens, the end of the request stream travels in-band: every ld/st idx port sends a 
+/// {kStoreQueueEnd, tag} request after its last one, and end_signal_pipe is void. The queue 
+/// counts the stores itself, and exits once all ports have ended, all loads were served, and all 
+/// stores have retired. The request loops can then exit on data-dependent conditions.
+///
+/// KernelId names the kernels of this queue. Several StoreQueues (on different pipes and arrays)
+/// can run in one program if each gets its own KernelId.
+template <typename ld_idx_pipes, typename ld_val_pipes, int num_ld_ports, typename st_idx_pipes,
+          typename st_val_pipes, int num_st_ports, typename end_signal_pipe, 
+          typename Config = StoreQueueDefaults, typename value_t, typename stats_t = std::nullptr_t>
+event StoreQueue(queue &q, region_table_t<value_t, Config::kNumRegions> regions, 
+                 stats_t stats = nullptr, int data_size = Config::MemoryBackend::kDepth) {
+  static_assert(std::is_base_of_v<StoreQueueDefaults, Config>, 
+                "Config must derive from StoreQueueDefaults.");
+  // The knobs of Config.
+  constexpr int QUEUE_SIZE = Config::kQueueSize;
+  constexpr bool FORWARDING = Config::kForwarding;
+  constexpr int SEARCH_WIDTH = Config::kSearchWidth;
+  constexpr int II = Config::kII;
+  constexpr int BLOOM_SIZE = Config::kBloomSize;
+  constexpr StoreRetire RETIRE = Config::kRetire;
+  using StoreLSU = typename Config::StoreLSU;
+  constexpr int WRITE_COMBINE = Config::kWriteCombine;
+  using MemoryBackend = typename Config::MemoryBackend;
+  constexpr int NUM_BANKS = Config::kNumBanks;
+  constexpr int MAX_TAG_DISTANCE = Config::kMaxTagDistance;
+  constexpr bool PERSISTENT = Config::kPersistent;
+  constexpr int WIDTH = Config::kWidth;
+  constexpr int LOAD_BUFFER_SIZE = Config::kLoadBufferSize;
+  constexpr int LOAD_CACHE_SIZE = Config::kLoadCacheSize;
+  constexpr int NUM_REGIONS = Config::kNumRegions;
+  constexpr bool UPDATE = Config::kUpdate;
+  constexpr bool CANCEL = Config::kCancel;
+  constexpr bool END_TOKENS = Config::kEndTokens;
+  using KernelId = typename Config::KernelId;
+
+  // Pointer to the element of a (region tagged) idx.
+  static_assert(NUM_REGIONS >= 1, "NUM_REGIONS must be >= 1.");
+  constexpr int kRegionShift = StoreQueueRegionShift<NUM_REGIONS>();
+  auto mem_ptr = [regions](int idx) {
+    if constexpr (NUM_REGIONS == 1)
+      return regions.base[0] + idx;
+    else
+      return regions.base[idx >> kRegionShift] + (idx & ((1 << kRegionShift) - 1));
+  };
+  device_ptr<value_t> data = regions.base[0];
+
+  constexpr bool kCollectStats = std::is_same_v<stats_t, StoreQueueStats*>;
+  static_assert(kCollectStats || std::is_same_v<stats_t, std::nullptr_t>, 
+                "stats must be a StoreQueueStats* or nullptr.");
+
+  // The lanes of a wide pipe port are handled as separate load (store) ports.
+  static_assert(WIDTH >= 1, "WIDTH must be >= 1.");
+  constexpr int num_lds = num_ld_ports * WIDTH;
+  constexpr int num_sts = num_st_ports * WIDTH;
+
+  static_assert(!(END_TOKENS && PERSISTENT), 
+                "A PERSISTENT queue ends its batches (and shuts down) on the end_signal_pipe.");
+  static_assert(!PERSISTENT || num_sts == 1, 
+                "A PERSISTENT queue finds the end of a batch by counting its stores in tag order.");
+  static_assert(END_TOKENS == std::is_void_v<end_signal_pipe>, 
+                "The end_signal_pipe is void exactly when the end is sent in-band (END_TOKENS).");
+
   // Use minimum number of bits for store_q iterator.
   constexpr int kQueueLoopIterBitSize = fpga_tools::BitsForMaxValue<QUEUE_SIZE+1>();
   using storeq_idx_t = ac_int<kQueueLoopIterBitSize, false>;
   
+  // Number of search pipeline stages needed to compare a load against all entries of a bank.
+  constexpr int kNumSearchStages = (QUEUE_SIZE + SEARCH_WIDTH - 1) / SEARCH_WIDTH;
+
+  // Two tags at most MAX_TAG_DISTANCE apart are ordered correctly modulo 2^kTagBits. Every port 
+  // can hold NUM_BANKS * QUEUE_SIZE stores with distinct tags, so a smaller bound is never right.
+  constexpr bool kUseNarrowTags = (MAX_TAG_DISTANCE > 0);
+  static_assert(MAX_TAG_DISTANCE >= 0 && MAX_TAG_DISTANCE < (1 << 30), 
+                "MAX_TAG_DISTANCE must fit 32-bit tags.");
+  static_assert(!kUseNarrowTags || MAX_TAG_DISTANCE >= NUM_BANKS * QUEUE_SIZE, 
+                "MAX_TAG_DISTANCE is below the number of stores a port can hold.");
+  constexpr int kTagBits = 
+      kUseNarrowTags ? fpga_tools::BitsForMaxValue<MAX_TAG_DISTANCE>() + 1 : 32;
+  using tag_t = ac_int<kTagBits, false>;
+  using tag_diff_t = ac_int<kTagBits, true>;
+  // Wraparound-aware tag order: a precedes b if (a - b) is negative in kTagBits bits.
+  auto tag_lt = [](tag_t a, tag_t b) { return tag_diff_t(a - b) < 0; };
+  auto tag_le = [](tag_t a, tag_t b) { return tag_diff_t(b - a) >= 0; };
+
   struct store_entry {
     int idx;
-    int tag;
+    tag_t tag;
     bool waiting_for_val;
+    // Has its value, but was not yet written to memory (only with WRITE_COMBINE).
+    bool is_dirty;
     int16_t countdown;
+    // Was cancelled: holds the current value of idx, but is not written (only with CANCEL).
+    bool is_cancelled;
+    // Cancelled with no older store to its idx in the queue: holds no value, and a load that 
+    // matches it reads memory (only with CANCEL).
+    bool is_val_in_mem;
+    // The base load of a younger update was served without the value of this store, so it stays 
+    // in the queue until that update has taken the value (only with UPDATE).
+    bool is_update_base;
+  };
+
+  static_assert(fpga_tools::IsPow2(NUM_BANKS), "NUM_BANKS must be pow2.");
+  auto bank_of = [](int idx) { return idx & (NUM_BANKS - 1); };
+
+  constexpr int kStorePortIterBitSize = fpga_tools::BitsForMaxValue<num_sts+1>();
+  using stport_idx_t = ac_int<kStorePortIterBitSize, false>;
+
+  // Counting Bloom filter: two bit-slice hashes of the idx, one counter per bucket. A store is
+  // counted from allocation until retirement. Counters must hold 2 increments per entry, since 
+  // both hashes can pick the same bucket. The allocations and retirements of an iteration are 
+  // first summed into a delta per bucket, which does not depend on the counters, so only one add 
+  // per counter is on the loop-carried path.
+  static_assert(BLOOM_SIZE == 0 || fpga_tools::IsPow2(BLOOM_SIZE), "BLOOM_SIZE must be pow2.");
+  constexpr bool kUseBloomFilter = (BLOOM_SIZE > 0);
+  constexpr int kBloomSize = kUseBloomFilter ? BLOOM_SIZE : 1;
+  constexpr int kBloomHashBits = fpga_tools::Log2(kBloomSize);
+  constexpr int kBloomCounterBitSize = 
+      fpga_tools::BitsForMaxValue<2*num_sts*NUM_BANKS*QUEUE_SIZE>();
+  using bloom_cnt_t = ac_int<kBloomCounterBitSize, false>;
+  using bloom_delta_t = ac_int<kBloomCounterBitSize + 1, true>;
+  auto bloom_hash_0 = [](int idx) { return idx & (kBloomSize - 1); };
+  auto bloom_hash_1 = [](int idx) { 
+    return ((idx >> kBloomHashBits) ^ (idx >> (2*kBloomHashBits))) & (kBloomSize - 1); 
+  };
+
+  constexpr bool kUseOnchipMemory = (MemoryBackend::kDepth > 0);
+  // The on-chip array is only instantiated with the OnchipMemory backend (a GlobalMemory depth 
+  // of 0 would give it 0 address bits and an empty cache).
+  using onchip_data_t = std::conditional_t<kUseOnchipMemory, 
+      fpga_tools::OnchipMemoryWithCache<value_t, MemoryBackend::kDepth, MemoryBackend::kCacheDepth>,
+      std::nullptr_t>;
+  // The store countdown: cycles until a store is visible to loads reading the memory.
+  constexpr int kStoreLatency = kUseOnchipMemory ? 0 : kLatencyPipelinedLSU;
+
+  constexpr bool kUseAckRetire = (RETIRE == StoreRetire::Ack);
+  static_assert(NUM_REGIONS == 1 || !kUseOnchipMemory, 
+                "The OnchipMemory backend holds a single array.");
+  static_assert(!(kUseAckRetire && kUseOnchipMemory), 
+                "The on-chip memory is private to the StoreQueue kernel. Use Countdown.");
+  static_assert(kUseAckRetire || std::is_same_v<StoreLSU, PipelinedLSU>,
+                "Countdown retirement relies on the fixed latency of the PipelinedLSU.");
+  // The StoreAck kernel acknowledges stores in batches, with one memory fence per batch. A bank
+  // never has more than QUEUE_SIZE stores waiting for an ack.
+  using ack_cnt_t = ac_int<fpga_tools::BitsForMaxValue<QUEUE_SIZE>(), false>;
+  struct store_ack_t { ack_cnt_t num_acks[NUM_BANKS]; };
+
+  static_assert(WRITE_COMBINE >= 0 && WRITE_COMBINE < QUEUE_SIZE, 
+                "WRITE_COMBINE must be in [0, QUEUE_SIZE).");
+  constexpr bool kUseWriteCombine = (WRITE_COMBINE > 0);
+  static_assert(FORWARDING || !kUseWriteCombine, 
+                "Without forwarding, loads would wait on dirty stores that are not yet written.");
+  // Store values only need to be kept in the queue to forward them, to write them later, or to 
+  // add the next update to them.
+  constexpr bool kKeepStoreVals = FORWARDING || kUseWriteCombine || UPDATE;
+  constexpr int kStoreValQueueSize = kKeepStoreVals ? QUEUE_SIZE : 1;
+
+  using st_val_t = std::conditional_t<CANCEL, store_val_t<value_t>, value_t>;
+  // The current value of a store's idx is needed to add an update to it, or to forward it from a 
+  // cancelled store.
+  constexpr bool kUseStoreBase = UPDATE || (CANCEL && kKeepStoreVals);
+  static_assert(!(UPDATE && kUseAckRetire), 
+                "The base of an update is held in the queue, but an acknowledged entry is freed.");
+
+  // A store that was combined away (!is_write) is only acknowledged, without writing memory.
+  struct store_commit_t { int idx; bool is_write; value_t val; };
+  using store_commit_pipes = PipeArray<class StoreCommitPipeClass, store_commit_t, QUEUE_SIZE, 
+                                       num_sts>;
+  using store_ack_pipes = PipeArray<class StoreAckPipeClass, store_ack_t, QUEUE_SIZE, num_sts>;
+  using store_ack_end_pipe = ext::intel::pipe<class StoreAckEndPipeClass, bool>;
+
+  constexpr bool kUseLoadKernel = (LOAD_BUFFER_SIZE > 0);
+  static_assert(!(kUseLoadKernel && kUseOnchipMemory), 
+                "The on-chip memory is private to the StoreQueue kernel.");
+  // A resolved load: the idx to read (is_load), or the forwarded value. Ended by is_end.
+  struct load_req_t { int idx; bool is_load; bool is_end; value_t val; };
+  using load_req_pipes = PipeArray<class LoadReqPipeClass, load_req_t, LOAD_BUFFER_SIZE, num_lds>;
+
+  constexpr bool kUseLoadCache = (LOAD_CACHE_SIZE > 0);
+  constexpr int kLoadCacheSize = kUseLoadCache ? LOAD_CACHE_SIZE : 1;
+  static_assert(!(kUseLoadCache && kUseLoadKernel), 
+                "The load cache is filled with values loaded by the StoreQueue kernel.");
+  using load_cache_idx_t = ac_int<fpga_tools::BitsForMaxValue<kLoadCacheSize>(), false>;
+  // An entry with idx -1 is empty.
+  struct load_cache_entry { int idx; value_t val; };
+
+  if constexpr (kUseAckRetire) {
+    q.submit([&](handler &hnd) {
+      hnd.single_task<StoreAckKernel<KernelId>>([=]() [[intel::kernel_args_restrict]] {
+        [[intel::fpga_register]] ack_cnt_t num_unacked[num_sts][NUM_BANKS];
+        #pragma unroll
+        for (uint s = 0; s < num_sts; ++s) {
+          #pragma unroll
+          for (uint b = 0; b < NUM_BANKS; ++b)
+            num_unacked[s][b] = 0;
+        }
+        int num_unacked_total = 0;
+        bool end_signal = false;
+
+        while (!end_signal || num_unacked_total > 0) {
+          bool is_any_new_store = false;
+          UnrolledLoop<num_sts>([&](auto s) {
+            bool commit_pipe_succ = false;
+            auto commit = store_commit_pipes:: template PipeAt<s>::read(commit_pipe_succ);
+            if (commit_pipe_succ) {
+              if (commit.is_write)
+                StoreLSU::store(mem_ptr(commit.idx), commit.val);
+              num_unacked[s][bank_of(commit.idx)]++;
+              num_unacked_total++;
+              is_any_new_store = true;
+            }
+          });
+
+          // The fence only completes once all preceding writes are visible in memory. Fence when 
+          // the store stream pauses, or when a whole queue worth of stores waits for an ack.
+          if (num_unacked_total > 0 && 
+              (!is_any_new_store || num_unacked_total >= QUEUE_SIZE)) {
+            sycl::atomic_fence(sycl::memory_order::seq_cst, sycl::memory_scope::device);
+            UnrolledLoop<num_sts>([&](auto s) {
+              store_ack_t acks;
+              bool is_any_ack = false;
+              #pragma unroll
+              for (uint b = 0; b < NUM_BANKS; ++b) {
+                acks.num_acks[b] = num_unacked[s][b];
+                is_any_ack |= (num_unacked[s][b] > 0);
+                num_unacked[s][b] = 0;
+              }
+              if (is_any_ack)
+                store_ack_pipes:: template PipeAt<s>::write(acks);
+            });
+            num_unacked_total = 0;
+          }
+
+          if (!end_signal)
+            store_ack_end_pipe::read(end_signal);
+        }
+      });
+    });
+  }
+
+  if constexpr (kUseLoadKernel) {
+    UnrolledLoop<num_ld_ports>([&](auto p) {
+      constexpr int kPort = decltype(p)::value;
+      q.submit([&](handler &hnd) {
+        using LoadKernelName = StoreQueueLoadKernel<KernelId, kPort>;
+        hnd.single_task<LoadKernelName>([=]() [[intel::kernel_args_restrict]] {
+          // The lanes of a wide port are read together, since every group has all its lanes.
+          bool is_end = false;
+          [[intel::initiation_interval(1)]]
+          while (!is_end) {
+            group_t<value_t, WIDTH> vals;
+            UnrolledLoop<WIDTH>([&](auto j) {
+              auto req = load_req_pipes:: template PipeAt<kPort * WIDTH + j>::read();
+              vals.data[j] = req.is_load ? PipelinedLSU::load(mem_ptr(req.idx)) : req.val;
+              vals.valid[j] = (req.idx != -1);
+              is_end = req.is_end;
+            });
+
+            if (!is_end) {
+              if constexpr (WIDTH == 1)
+                ld_val_pipes:: template PipeAt<kPort>::write(vals.data[0]);
+              else
+                ld_val_pipes:: template PipeAt<kPort>::write(vals);
+            }
+          }
+        });
+      });
+    });
+  }
+
+  struct search_stage {
+    bool valid;
+    int idx;
+    tag_t tag;
+    // Tag and location of the youngest matching store found so far.
+    bool has_match;
+    tag_t max_tag;
+    stport_idx_t match_port;
+    storeq_idx_t match_slot;
+  };
+
+  // A store entry that matches a load (or update). The youngest of several candidates is picked by
+  // a balanced tree of pairwise tag comparisons, so the logic depth grows with the log of their 
+  // number instead of linearly. Matching stores never share a tag.
+  struct match_t {
+    bool valid;
+    tag_t tag;
+    stport_idx_t port;
+    storeq_idx_t slot;
+  };
+  auto select_youngest = [tag_lt](auto &cands) {
+    constexpr int kNumCands = std::extent_v<std::remove_reference_t<decltype(cands)>>;
+    #pragma unroll
+    for (int stride = 1; stride < kNumCands; stride *= 2) {
+      #pragma unroll
+      for (int c = 0; c + stride < kNumCands; c += 2 * stride) {
+        if (cands[c + stride].valid && 
+            (!cands[c].valid || tag_lt(cands[c].tag, cands[c + stride].tag)))
+          cands[c] = cands[c + stride];
+      }
+    }
+    return cands[0];
   };
 
   auto event = q.submit([&](handler &hnd) {
-    hnd.single_task<StoreQueueKernel>([=]() [[intel::kernel_args_restrict]] {
-      /// The store queue is a circular buffer.
-      [[intel::fpga_register]] store_entry store_entries[QUEUE_SIZE];
-      [[intel::fpga_register]] value_t store_entries_val[QUEUE_SIZE];
+    hnd.single_task<StoreQueueKernel<KernelId>>([=]() [[intel::kernel_args_restrict]] {
+      // Only used with the OnchipMemory backend.
+      onchip_data_t onchip_data;
+      if constexpr (kUseOnchipMemory) {
+        for (int i = 0; i < data_size; ++i)
+          onchip_data.write(i, data[i]);
+      }
+
+      auto load_from_mem = [&](int idx) {
+        if constexpr (kUseOnchipMemory)
+          return onchip_data.read(idx);
+        else 
+          return PipelinedLSU::load(mem_ptr(idx));
+      };
+      auto store_to_mem = [&](int idx, value_t val) {
+        if constexpr (kUseOnchipMemory)
+          onchip_data.write(idx, val);
+        else 
+          PipelinedLSU::store(mem_ptr(idx), val);
+      };
+
+      // Holds the memory value of an idx written by a committed store. Only looked up once no 
+      // store entry matches.
+      [[intel::fpga_register]] load_cache_entry load_cache[kLoadCacheSize];
+      load_cache_idx_t load_cache_next = 0;
+      #pragma unroll
+      for (uint c = 0; c < kLoadCacheSize; ++c)
+        load_cache[c].idx = -1;
+      // A committed store updates its idx in place, or allocates a new entry.
+      auto update_load_cache = [&](int idx, value_t val) {
+        bool is_cached = false;
+        #pragma unroll
+        for (uint c = 0; c < kLoadCacheSize; ++c) {
+          if (load_cache[c].idx == idx) {
+            load_cache[c].val = val;
+            is_cached = true;
+          }
+        }
+        if (!is_cached) {
+          load_cache[load_cache_next] = {idx, val};
+          load_cache_next = (load_cache_next + 1) % kLoadCacheSize;
+        }
+      };
+      auto load_through_cache = [&](int idx, bool &is_cache_hit) {
+        value_t val;
+        is_cache_hit = false;
+        if constexpr (kUseLoadCache) {
+          #pragma unroll
+          for (uint c = 0; c < kLoadCacheSize; ++c) {
+            if (load_cache[c].idx == idx) {
+              val = load_cache[c].val;
+              is_cache_hit = true;
+            }
+          }
+        }
+        if (!is_cache_hit)
+          val = load_from_mem(idx);
+        return val;
+      };
+
+      /// Each bank of a store port has its own circular buffer of QUEUE_SIZE entries.
+      [[intel::fpga_register]] store_entry store_entries[num_sts][NUM_BANKS][QUEUE_SIZE];
+      [[intel::fpga_register]] value_t store_entries_val[num_sts][NUM_BANKS][kStoreValQueueSize];
+      // Pointers into the bank's circular buffer. Tail is for values, Head for idxs. With 
+      // WRITE_COMBINE, entries in [Write, Tail) are dirty. With StoreRetire::Ack, entries in 
+      // [Ack, Write) are committed and wait for their write ack (Write == Tail if no combining).
+      [[intel::fpga_register]] storeq_idx_t stq_ack[num_sts][NUM_BANKS];
+      [[intel::fpga_register]] storeq_idx_t stq_write[num_sts][NUM_BANKS];
+      [[intel::fpga_register]] storeq_idx_t stq_tail[num_sts][NUM_BANKS];
+      [[intel::fpga_register]] storeq_idx_t stq_head[num_sts][NUM_BANKS];
 
       // Start with no valid entries in store queue.
       #pragma unroll
-      for (uint i = 0; i < QUEUE_SIZE; ++i)
-        store_entries[i] = {-1};
+      for (uint s = 0; s < num_sts; ++s) {
+        #pragma unroll
+        for (uint b = 0; b < NUM_BANKS; ++b) {
+          #pragma unroll
+          for (uint i = 0; i < QUEUE_SIZE; ++i)
+            store_entries[s][b][i] = {-1};
+          stq_ack[s][b] = 0;
+          stq_write[s][b] = 0;
+          stq_tail[s][b] = 0;
+          stq_head[s][b] = 0;
+        }
+      }
+
+      [[intel::fpga_register]] bloom_cnt_t bloom_filter[kBloomSize];
+      #pragma unroll
+      for (uint c = 0; c < kBloomSize; ++c)
+        bloom_filter[c] = 0;
 
       // The below are variables kept around across iterations.
       bool end_signal = false;
-      // How many store (valid) indexes were read from st_idx pipe.
-      int i_store_idx = 0;
-      // How many store values were accepted from st_val pipe.
-      int i_store_val = 0;
+      // How many store idxs were allocated on all ports (only with UPDATE, CANCEL or END_TOKENS).
+      int i_store_idx_total = 0;
+      // How many store values were accepted from all st_val pipes.
+      int i_store_val_total = 0;
+      // How many stores were written to memory, or combined away, from all ports.
+      int i_store_commit_total = 0;
+      // How many stores were acknowledged by the StoreAck kernel (only with StoreRetire::Ack).
+      int i_store_ack_total = 0;
       // Total number of stores to commit (supplied by the end_signal).
       int total_req_stores = 0;
-      // Pointers into the store_entries circular buffer. Tail is for values, Head for idxs.
-      storeq_idx_t stq_tail = 0;
-      storeq_idx_t stq_head = 0;
-      int tag_store = 0;
+      // Only used by a PERSISTENT queue: the finished batches, those not yet written to the batch 
+      // done pipe, and the iterations until the last commit of the batch is visible in memory.
+      int num_batches = 0;
+      int num_batches_unpublished = 0;
+      int16_t batch_countdown = kStoreLatency;
+      bool is_shutdown = false;
+
+      // Scalar book-keeping values for the store logic (one per store port).
+      // A store idx waits here until its bank has space.
+      NTuple<pair_t, num_sts> idx_tag_pair_store_tp;
+      NTuple<bool, num_sts> is_store_idx_pending_tp;
+      NTuple<tag_t, num_sts> tag_store_tp;
+      NTuple<int, num_sts> num_dirty_tp;
+      // The bank holding the oldest store waiting for its value, and the oldest dirty store.
+      NTuple<int, num_sts> val_bank_tp;
+      NTuple<int, num_sts> write_bank_tp;
+      NTuple<bool, num_sts> is_val_waiting_tp;
+      // Can the oldest uncommitted entry of the port be committed without reordering a store to 
+      // the same idx. And is it overwritten by a younger store to the same idx (with its value).
+      NTuple<bool, num_sts> is_commit_safe_tp;
+      NTuple<bool, num_sts> is_overwritten_tp;
+      // With UPDATE (CANCEL): can the store waiting for its delta (or cancel token) read the 
+      // current value of its idx, and the store entry holding that value (if not valid, then the 
+      // value is in memory).
+      NTuple<bool, num_sts> is_update_ready_tp;
+      NTuple<match_t, num_sts> update_base_tp;
+      NTuple<value_t, num_sts> update_base_val_tp;
+      // A committed store that could not yet be written to the store_commit pipe.
+      NTuple<store_commit_t, num_sts> pending_commit_tp;
+      NTuple<bool, num_sts> is_commit_pending_tp;
+      // Has the port read its end token (only with END_TOKENS).
+      NTuple<bool, num_sts> is_store_end_tp;
+      UnrolledLoop<num_sts>([&](auto s) {
+        is_store_idx_pending_tp. template get<s>() = false;
+        is_store_end_tp. template get<s>() = false;
+        num_dirty_tp. template get<s>() = 0;
+        val_bank_tp. template get<s>() = 0;
+        write_bank_tp. template get<s>() = 0;
+        is_commit_pending_tp. template get<s>() = false;
+        tag_store_tp. template get<s>() = 0;
+      });
+
+#if FPGA_EMULATOR
+      // Emulation only: the full tags of the store entries and of the last store of every port, 
+      // to assert that the tags compared in the queue are at most MAX_TAG_DISTANCE apart.
+      int full_entry_tag[num_sts][NUM_BANKS][QUEUE_SIZE] = {};
+      int full_tag_store[num_sts] = {};
+      auto assert_tag_distance = [&](int tag) {
+        if constexpr (kUseNarrowTags) {
+          for (int s = 0; s < num_sts; ++s) {
+            assert(tag - full_tag_store[s] <= MAX_TAG_DISTANCE && 
+                   full_tag_store[s] - tag <= MAX_TAG_DISTANCE);
+            for (int b = 0; b < NUM_BANKS; ++b) {
+              for (int i = 0; i < QUEUE_SIZE; ++i) {
+                const int other = full_entry_tag[s][b][i];
+                assert(store_entries[s][b][i].idx == -1 || 
+                       (tag - other <= MAX_TAG_DISTANCE && other - tag <= MAX_TAG_DISTANCE));
+              }
+            }
+          }
+        }
+      };
+#endif
 
       // Scalar book-keeping values for the load logic (one per load, NTuple expanded at compile).
-      NTuple<value_t, num_lds> val_load_tp;
+      // A load request waits here until all stores preceding it have arrived.
       NTuple<pair_t, num_lds> idx_tag_pair_load_tp;
-      NTuple<int, num_lds> idx_load_tp;
-      NTuple<int, num_lds> tag_load_tp;
-      NTuple<bool, num_lds> consumer_load_succ_tp;
-      NTuple<bool, num_lds> is_load_waiting_tp;
-      NTuple<bool, num_lds> is_load_rq_finished_tp;
+      NTuple<bool, num_lds> is_load_pending_tp;
+      // The head of the search pipeline: a searched load waiting for its value.
+      NTuple<search_stage, num_lds> resolve_stage_tp;
+      NTuple<bool, num_lds> is_load_resolving_tp;
+      NTuple<bool, num_lds> is_val_ready_tp;
+      NTuple<value_t, num_lds> val_load_tp;
+      // The value is still to be read from memory (only with LOAD_BUFFER_SIZE > 0).
+      NTuple<bool, num_lds> is_val_from_mem_tp;
+      NTuple<bool, num_lds> is_load_end_tp;
       UnrolledLoop<num_lds>([&](auto k) {
-        consumer_load_succ_tp. template get<k>() = true;
-        tag_load_tp. template get<k>() = 0;
-        is_load_waiting_tp. template get<k>() = false;
-        is_load_rq_finished_tp. template get<k>() = true;
+        is_load_pending_tp. template get<k>() = false;
+        is_load_end_tp. template get<k>() = false;
+        is_load_resolving_tp. template get<k>() = false;
+        is_val_ready_tp. template get<k>() = false;
       });
 
+      /// Each load port has a search pipeline. Stage j compares against entries 
+      /// [j*SEARCH_WIDTH, (j+1)*SEARCH_WIDTH) of the load's bank in every store port, so a new load
+      /// can enter on every iteration and the comparator depth per iteration is bounded by 
+      /// SEARCH_WIDTH.
+      [[intel::fpga_register]] search_stage ld_stages[num_lds][kNumSearchStages];
+      #pragma unroll
+      for (uint k = 0; k < num_lds; ++k) {
+        #pragma unroll
+        for (uint j = 0; j < kNumSearchStages; ++j)
+          ld_stages[k][j].valid = false;
+      }
+
+      /// With WIDTH > 1, the group last read from (or to be written to) every pipe port, and which
+      /// of its lanes still hold a request (value). Lane j of port p is served to port p*WIDTH+j.
+      [[intel::fpga_register]] group_t<pair_t, WIDTH> ld_idx_group[num_ld_ports];
+      [[intel::fpga_register]] group_t<value_t, WIDTH> ld_val_group[num_ld_ports];
+      [[intel::fpga_register]] group_t<pair_t, WIDTH> st_idx_group[num_st_ports];
+      [[intel::fpga_register]] group_t<st_val_t, WIDTH> st_val_group[num_st_ports];
+      [[intel::fpga_register]] bool is_ld_idx_lane_full[num_ld_ports][WIDTH];
+      [[intel::fpga_register]] bool is_ld_val_lane_full[num_ld_ports][WIDTH];
+      [[intel::fpga_register]] bool is_st_idx_lane_full[num_st_ports][WIDTH];
+      [[intel::fpga_register]] bool is_st_val_lane_full[num_st_ports][WIDTH];
+      #pragma unroll
+      for (uint j = 0; j < WIDTH; ++j) {
+        #pragma unroll
+        for (uint p = 0; p < num_ld_ports; ++p) {
+          is_ld_idx_lane_full[p][j] = false;
+          is_ld_val_lane_full[p][j] = false;
+        }
+        #pragma unroll
+        for (uint p = 0; p < num_st_ports; ++p) {
+          is_st_idx_lane_full[p][j] = false;
+          is_st_val_lane_full[p][j] = false;
+        }
+      }
+
+      // Port k (s) reads its requests and values through these. An unused {idx, tag} lane arrives 
+      // as idx -1, which only moves the tag of its port forward.
+      auto read_ld_idx = [&](auto k, bool &succ) {
+        if constexpr (WIDTH == 1) {
+          return ld_idx_pipes:: template PipeAt<k>::read(succ);
+        } else {
+          constexpr int p = k / WIDTH;
+          constexpr int j = k % WIDTH;
+          succ = is_ld_idx_lane_full[p][j];
+          is_ld_idx_lane_full[p][j] = false;
+          pair_t req = ld_idx_group[p].data[j];
+          if (!ld_idx_group[p].valid[j])
+            req.first = -1;
+          return req;
+        }
+      };
+      auto write_ld_val = [&](auto k, value_t val, bool is_valid, bool &succ) {
+        if constexpr (WIDTH == 1) {
+          ld_val_pipes:: template PipeAt<k>::write(val, succ);
+        } else {
+          constexpr int p = k / WIDTH;
+          constexpr int j = k % WIDTH;
+          succ = !is_ld_val_lane_full[p][j];
+          if (succ) {
+            ld_val_group[p].data[j] = val;
+            ld_val_group[p].valid[j] = is_valid;
+            is_ld_val_lane_full[p][j] = true;
+          }
+        }
+      };
+      auto read_st_idx = [&](auto s, bool &succ) {
+        if constexpr (WIDTH == 1) {
+          return st_idx_pipes:: template PipeAt<s>::read(succ);
+        } else {
+          constexpr int p = s / WIDTH;
+          constexpr int j = s % WIDTH;
+          succ = is_st_idx_lane_full[p][j];
+          is_st_idx_lane_full[p][j] = false;
+          pair_t req = st_idx_group[p].data[j];
+          if (!st_idx_group[p].valid[j])
+            req.first = -1;
+          return req;
+        }
+      };
+      auto read_st_val = [&](auto s, bool &succ) {
+        if constexpr (WIDTH == 1) {
+          return st_val_pipes:: template PipeAt<s>::read(succ);
+        } else {
+          constexpr int p = s / WIDTH;
+          constexpr int j = s % WIDTH;
+          succ = is_st_val_lane_full[p][j];
+          is_st_val_lane_full[p][j] = false;
+          return st_val_group[p].data[j];
+        }
+      };
+
+
+      // The search is spread over kNumSearchStages iterations, so the II does not depend on the 
+      // number of store_q entries. ivdep (ignore mem dependencies): The logic guarantees 
+      // dependencies are honoured.
+      int64_t num_iterations = 0;
+      int64_t num_loads_forwarded = 0;
+      int64_t num_loads_from_mem = 0;
+      int64_t num_loads_from_cache = 0;
+      int64_t num_stalls_tag = 0;
+      int64_t num_stalls_waiting_for_val = 0;
+      int64_t num_queue_full = 0;
 
-      // Setting Inititation Interval to the number of store_q entries ensures that we are not
-      // increasing the critical path of the resulting circuit by too much, or not at all in most 
-      // cases. ivdep (ignore mem dependencies): The logic guarantees dependencies are honoured.
-      [[intel::initiation_interval(QUEUE_SIZE)]] 
+      [[intel::initiation_interval(II)]] 
       [[intel::ivdep]] 
-      while (!end_signal || i_store_val < total_req_stores) {
+      while (!end_signal || 
+             (kUseAckRetire ? i_store_ack_total : i_store_commit_total) < total_req_stores ||
+             (PERSISTENT && (!is_shutdown || num_batches_unpublished > 0))) {
+        if constexpr (kCollectStats)
+          num_iterations++;
+
+        // A new group is read once all lanes of the previous one have been taken. Unused store 
+        // value lanes are never taken.
+        if constexpr (WIDTH > 1) {
+          UnrolledLoop<num_ld_ports>([&](auto p) {
+            bool is_group_empty = true;
+            #pragma unroll
+            for (uint j = 0; j < WIDTH; ++j)
+              is_group_empty &= !is_ld_idx_lane_full[p][j];
+            if (is_group_empty) {
+              bool ld_idx_pipe_succ = false;
+              ld_idx_group[p] = ld_idx_pipes:: template PipeAt<p>::read(ld_idx_pipe_succ);
+              #pragma unroll
+              for (uint j = 0; j < WIDTH; ++j)
+                is_ld_idx_lane_full[p][j] = ld_idx_pipe_succ;
+            }
+          });
+          UnrolledLoop<num_st_ports>([&](auto p) {
+            bool is_idx_group_empty = true;
+            bool is_val_group_empty = true;
+            #pragma unroll
+            for (uint j = 0; j < WIDTH; ++j) {
+              is_idx_group_empty &= !is_st_idx_lane_full[p][j];
+              is_val_group_empty &= !is_st_val_lane_full[p][j];
+            }
+            if (is_idx_group_empty) {
+              bool st_idx_pipe_succ = false;
+              st_idx_group[p] = st_idx_pipes:: template PipeAt<p>::read(st_idx_pipe_succ);
+              #pragma unroll
+              for (uint j = 0; j < WIDTH; ++j)
+                is_st_idx_lane_full[p][j] = st_idx_pipe_succ;
+            }
+            if (is_val_group_empty) {
+              bool st_val_pipe_succ = false;
+              st_val_group[p] = st_val_pipes:: template PipeAt<p>::read(st_val_pipe_succ);
+              #pragma unroll
+              for (uint j = 0; j < WIDTH; ++j)
+                is_st_val_lane_full[p][j] = st_val_pipe_succ && st_val_group[p].valid[j];
+            }
+          });
+        }
+
+        // A load can only be disambiguated once every store port has received all store idxs that
+        // precede it in program order.
+        tag_t min_tag_store = tag_store_tp. template get<0>();
+        UnrolledLoop<1, num_sts>([&](auto s) {
+          if (tag_lt(tag_store_tp. template get<s>(), min_tag_store))
+            min_tag_store = tag_store_tp. template get<s>();
+        });
+
         /* Start Load Logic */
         // All loads can proceed in parallel. The below unrolls the template PipeArray/NTuple. 
         UnrolledLoop<num_lds>([&](auto k) {
           // Use shorter names.
-          auto& val_load = val_load_tp. template get<k>();
           auto& idx_tag_pair_load = idx_tag_pair_load_tp. template get<k>();
-          auto& idx_load = idx_load_tp. template get<k>();
-          auto& tag_load = tag_load_tp. template get<k>();
-          auto& consumer_pipe_succ = consumer_load_succ_tp. template get<k>();
-          auto& is_load_waiting = is_load_waiting_tp. template get<k>();
-          auto& is_load_rq_finished = is_load_rq_finished_tp. template get<k>();
+          auto& is_load_pending = is_load_pending_tp. template get<k>();
+          auto& resolve_stage = resolve_stage_tp. template get<k>();
+          auto& is_load_resolving = is_load_resolving_tp. template get<k>();
+          auto& is_val_ready = is_val_ready_tp. template get<k>();
+          auto& val_load = val_load_tp. template get<k>();
+          auto& is_val_from_mem = is_val_from_mem_tp. template get<k>();
 
-          // Check for new ld requests, only once the prev one was completed.
-          if (is_load_rq_finished) {
-            bool idx_load_pipe_succ = false;
-            idx_tag_pair_load = ld_idx_pipes:: template PipeAt<k>::read(idx_load_pipe_succ);
+          // The searched load takes the value of the youngest matching store. Only that one entry 
+          // is re-checked, so a load waiting for a store value does not need to search again. If 
+          // the entry no longer holds the store, then it has retired and memory is up to date.
+          if (is_load_resolving && !is_val_ready) {
+            bool is_match_in_stq = false;
+            if (resolve_stage.has_match) {
+              const int b = bank_of(resolve_stage.idx);
+              auto st_entry = 
+                  store_entries[resolve_stage.match_port][b][resolve_stage.match_slot];
+              is_match_in_stq = (st_entry.idx == resolve_stage.idx && 
+                                 st_entry.tag == resolve_stage.max_tag && !st_entry.is_val_in_mem);
+              // Without forwarding, the load waits until the entry retires. The base load of an 
+              // update does not wait: the queue adds the store value to the update.
+              const bool is_forwarding = 
+                  is_match_in_stq && (UPDATE || (!st_entry.waiting_for_val && FORWARDING));
+              if constexpr (UPDATE) {
+                if (is_forwarding) {
+                  val_load = value_t();
+                  store_entries[resolve_stage.match_port][b][resolve_stage.match_slot]
+                      .is_update_base = true;
+                  is_val_ready = true;
+                }
+              } else if constexpr (FORWARDING) {
+                if (is_forwarding) {
+                  val_load = 
+                      store_entries_val[resolve_stage.match_port][b][resolve_stage.match_slot];
+                  is_val_ready = true;
+                }
+              }
+
+              if constexpr (kCollectStats) {
+                num_loads_forwarded += is_forwarding;
+                num_stalls_waiting_for_val += (is_match_in_stq && !is_forwarding);
+              }
+            }
 
-            if (idx_load_pipe_succ) {
-              is_load_rq_finished = false;
-              idx_load = idx_tag_pair_load.first;
-              tag_load = idx_tag_pair_load.second;
+            if (!is_match_in_stq) {
+              is_val_from_mem = false;
+              if (WIDTH > 1 && resolve_stage.idx == -1) {
+                val_load = value_t();
+              } else {
+                bool is_cache_hit = false;
+                if constexpr (kUseLoadKernel)
+                  is_val_from_mem = true;
+                else
+                  val_load = load_through_cache(resolve_stage.idx, is_cache_hit);
+
+                if constexpr (kCollectStats) {
+                  num_loads_from_cache += is_cache_hit;
+                  num_loads_from_mem += !is_cache_hit;
+                }
+              }
+              is_val_ready = true;
+            } else {
+              is_val_from_mem = false;
             }
           }
 
-          if (!is_load_rq_finished) {
-            // If the load tag sequence has overtaken the store tags, then we cannot possibly
-            // disambiguate -- need to wait for more store idxs to arrive. 
-            is_load_waiting = (tag_load > tag_store);
-            int max_tag = -1;
+          if (is_val_ready) {
+            // The ld. req. is deemed finished once the consumer pipe (or the load buffer) has been 
+            // successfully written.
+            bool consumer_pipe_succ = false;
+            if constexpr (kUseLoadKernel) {
+              load_req_pipes:: template PipeAt<k>::write(
+                  {resolve_stage.idx, is_val_from_mem, false, val_load}, consumer_pipe_succ);
+            } else {
+              write_ld_val(k, val_load, resolve_stage.idx != -1, consumer_pipe_succ);
+            }
+            is_load_resolving = !consumer_pipe_succ;
+            is_val_ready = !consumer_pipe_succ;
+          }
 
+          // Advance the search pipeline, unless its head is still occupied.
+          if (!is_load_resolving) {
             #pragma unroll
-            for (storeq_idx_t i = 0; i < QUEUE_SIZE; ++i) {
-              auto st_entry = store_entries[i];
-              if (st_entry.idx == idx_load &&   // If found store with same idx as ld,
-                  st_entry.tag <= tag_load &&   // make sure the store occured before the ld,
-                  st_entry.tag > max_tag) {     // and it is the youngest that did so. 
-                is_load_waiting |= st_entry.waiting_for_val;
-                val_load = store_entries_val[i];
-                max_tag = st_entry.tag;
+            for (int j = kNumSearchStages - 1; j >= 0; --j) {
+              auto stage = ld_stages[k][j];
+              const int b = bank_of(stage.idx);
+
+              // All entries of the stage are compared in parallel, then the youngest match is 
+              // selected by the tree and merged with the match of the previous stages.
+              match_t cands[num_sts * SEARCH_WIDTH];
+              #pragma unroll
+              for (uint s = 0; s < num_sts; ++s) {
+                #pragma unroll
+                for (int w = 0; w < SEARCH_WIDTH; ++w) {
+                  const int i = j * SEARCH_WIDTH + w;
+                  auto& cand = cands[s * SEARCH_WIDTH + w];
+                  cand.valid = false;
+                  if (i < QUEUE_SIZE) {
+                    auto st_entry = store_entries[s][b][i];
+                    cand.valid = (st_entry.idx == stage.idx &&        // A store with same idx,
+                                  tag_le(st_entry.tag, stage.tag));   // that occured before.
+                    cand.tag = st_entry.tag;
+                    cand.port = s;
+                    cand.slot = i;
+                  }
+                }
+              }
+
+              auto youngest = select_youngest(cands);
+              if (youngest.valid && (!stage.has_match || tag_lt(stage.max_tag, youngest.tag))) {
+                stage.has_match = true;
+                stage.max_tag = youngest.tag;
+                stage.match_port = youngest.port;
+                stage.match_slot = youngest.slot;
+              }
+
+              if (j == kNumSearchStages - 1) {
+                resolve_stage = stage;
+                is_load_resolving = stage.valid;
+              } else {
+                ld_stages[k][j + 1] = stage;
               }
             }
+            ld_stages[k][0].valid = false;
+          }
 
-            // If true, this means that the requested idx is not in the store queue.  
-            // Else, val_load would have been assigned in the search loop above.
-            if (!is_load_waiting && max_tag == -1) 
-              val_load = PipelinedLSU::load(data + idx_load);
-            
-            // Setting consumer_load_succ=false forces a write to load consumer pipe.
-            consumer_pipe_succ = is_load_waiting;
+          // Check for new ld requests, only once the prev one has entered the search pipeline.
+          auto& is_load_end = is_load_end_tp. template get<k>();
+          if (!is_load_pending && !is_load_end) {
+            idx_tag_pair_load = read_ld_idx(k, is_load_pending);
+            if (END_TOKENS && is_load_pending && idx_tag_pair_load.first == kStoreQueueEnd) {
+              is_load_end = true;
+              is_load_pending = false;
+            }
           }
 
-          if (!consumer_pipe_succ) {
-            // The ld. req. is deemed finished once the consumer pipe has been successfully written.
-            ld_val_pipes:: template PipeAt<k>::write(val_load, consumer_pipe_succ);
-            is_load_rq_finished = consumer_pipe_succ;
+          // If the load tag sequence has overtaken the store tags, then we cannot possibly
+          // disambiguate -- need to wait for more store idxs to arrive. Stores arriving after 
+          // this point are younger than the load, so the search cannot miss a dependency.
+          // An unused lane of a wide port (idx -1) needs no disambiguation.
+          const bool is_load_unused = (WIDTH > 1 && idx_tag_pair_load.first == -1);
+          const bool is_load_tag_ready = 
+              is_load_unused || tag_le(tag_t(idx_tag_pair_load.second), min_tag_store);
+          if constexpr (kCollectStats)
+            num_stalls_tag += (is_load_pending && !is_load_tag_ready);
+
+          if (is_load_pending && is_load_tag_ready) {
+#if FPGA_EMULATOR
+            if (!is_load_unused)
+              assert_tag_distance(idx_tag_pair_load.second);
+#endif
+            search_stage new_stage = {true, idx_tag_pair_load.first, 
+                                      tag_t(idx_tag_pair_load.second), false, 0, 0, 0};
+
+            // A Bloom filter miss means no store to this idx is in flight. Such a load (or an 
+            // unused lane) goes straight to the pipeline head, if no older load of this port is 
+            // still searching. Otherwise a missing load enters the search stage just behind the 
+            // youngest searching load, which keeps the loads of the port in order. Skipping part 
+            // of the search is safe, since any store to its idx allocated later is younger.
+            int first_busy_stage = kNumSearchStages;
+            #pragma unroll
+            for (int j = kNumSearchStages - 1; j >= 0; --j) {
+              if (ld_stages[k][j].valid)
+                first_busy_stage = j;
+            }
+            const bool is_search_empty = 
+                !is_load_resolving && first_busy_stage == kNumSearchStages;
+
+            bool is_bloom_miss = false;
+            if constexpr (kUseBloomFilter) {
+              is_bloom_miss = (bloom_filter[bloom_hash_0(new_stage.idx)] == 0 || 
+                               bloom_filter[bloom_hash_1(new_stage.idx)] == 0);
+            }
+
+            if ((is_bloom_miss || is_load_unused) && is_search_empty) {
+              resolve_stage = new_stage;
+              is_load_resolving = true;
+              is_load_pending = false;
+            } else if (is_bloom_miss && first_busy_stage > 0) {
+              ld_stages[k][first_busy_stage - 1] = new_stage;
+              is_load_pending = false;
+            } else if (!is_load_unused && !ld_stages[k][0].valid) {
+              ld_stages[k][0] = new_stage;
+              is_load_pending = false;
+            }
           }
         }); 
+
+        // A wide load port writes its value group once every lane has its value.
+        if constexpr (WIDTH > 1) {
+          UnrolledLoop<num_ld_ports>([&](auto p) {
+            bool is_group_full = true;
+            #pragma unroll
+            for (uint j = 0; j < WIDTH; ++j)
+              is_group_full &= is_ld_val_lane_full[p][j];
+            if (is_group_full) {
+              bool ld_val_pipe_succ = false;
+              ld_val_pipes:: template PipeAt<p>::write(ld_val_group[p], ld_val_pipe_succ);
+              #pragma unroll
+              for (uint j = 0; j < WIDTH; ++j)
+                is_ld_val_lane_full[p][j] = !ld_val_pipe_succ;
+            }
+          });
+        }
         /* End Load Logic */
       
 
         /* Start Store Logic */
-        bool is_space_in_stq = (store_entries[stq_head].idx == -1);
+        // Each port commits its stores in tag order, which is spread over the banks. The oldest 
+        // store waiting for its value (and, with WRITE_COMBINE, the oldest dirty store) sits at 
+        // the tail (write) pointer of the bank with the smallest such tag.
+        //
+        // Stores to the same idx on different ports must reach memory in tag order. A port's 
+        // oldest uncommitted entry is held back while an older store to the same idx is not yet 
+        // written on another port (or, with StoreRetire::Ack, not yet acknowledged). Decided for 
+        // all ports before any commit, so two ports never commit the same idx in one iteration.
+        // Dirty stores are all written once the end is reached, or when any port is full.
+        // (The totals of a PERSISTENT queue can include stores of the next batch.)
+        bool is_drain = (end_signal && i_store_val_total >= total_req_stores);
+        // No store can be missing once all of them have arrived, even if a port's tag lags.
+        const bool is_all_store_idx_in = (end_signal && i_store_idx_total >= total_req_stores);
+        // Bloom filter buckets hashed by the stores allocated (+) and retired (-) this iteration.
+        bloom_delta_t bloom_delta[kBloomSize];
         #pragma unroll
-        for (storeq_idx_t i = 0; i < QUEUE_SIZE; ++i) {
-          // Invalidate idx if count WILL GO to 0 on this iteration.
-          // On every iteration, decrement counter for stores in-flight.
-          if (store_entries[i].countdown < int16_t(1) && !store_entries[i].waiting_for_val) 
-            store_entries[i].idx = -1;
-          else 
-            store_entries[i].countdown--;
-        }
+        for (uint c = 0; c < kBloomSize; ++c)
+          bloom_delta[c] = 0;
+        UnrolledLoop<num_sts>([&](auto s) {
+          auto& val_bank = val_bank_tp. template get<s>();
+          auto& write_bank = write_bank_tp. template get<s>();
+          auto& is_val_waiting = is_val_waiting_tp. template get<s>();
 
-        // If store_q not full, check for new store_idx requests.
-        if (is_space_in_stq) {
-          bool idx_store_pipe_succ = false;
-          pair_t idx_tag_pair_store = st_idx_pipe::read(idx_store_pipe_succ);
+          is_val_waiting = false;
+          bool is_dirty_found = false;
+          tag_t min_val_tag = 0;
+          tag_t min_write_tag = 0;
+          #pragma unroll
+          for (int b = 0; b < NUM_BANKS; ++b) {
+            auto tail_entry = store_entries[s][b][stq_tail[s][b]];
+            if (tail_entry.waiting_for_val && 
+                (!is_val_waiting || tag_lt(tail_entry.tag, min_val_tag))) {
+              val_bank = b;
+              min_val_tag = tail_entry.tag;
+              is_val_waiting = true;
+            }
 
-          if (idx_store_pipe_succ) {
+            auto write_entry = store_entries[s][b][stq_write[s][b]];
+            if (kUseWriteCombine && write_entry.is_dirty && 
+                (!is_dirty_found || tag_lt(write_entry.tag, min_write_tag))) {
+              write_bank = b;
+              min_write_tag = write_entry.tag;
+              is_dirty_found = true;
+            }
+          }
+
+          const int commit_bank = kUseWriteCombine ? write_bank : val_bank;
+          const int commit_slot = kUseWriteCombine ? stq_write[s][write_bank] 
+                                                   : stq_tail[s][val_bank];
+          auto commit_entry = store_entries[s][commit_bank][commit_slot];
+          bool is_commit_safe = true;
+          bool is_overwritten = false;
+
+          UnrolledLoop<num_sts>([&](auto s_other) {
+            #pragma unroll
+            for (storeq_idx_t i = 0; i < QUEUE_SIZE; ++i) {
+              auto other_entry = store_entries[s_other][commit_bank][i];
+              if (other_entry.idx == commit_entry.idx) {
+                if (s_other != s && tag_lt(other_entry.tag, commit_entry.tag) &&
+                    (other_entry.waiting_for_val || other_entry.is_dirty || kUseAckRetire))
+                  is_commit_safe = false;
+                if (kUseWriteCombine && tag_lt(commit_entry.tag, other_entry.tag) && 
+                    !other_entry.waiting_for_val && !other_entry.is_cancelled)
+                  is_overwritten = true;
+              }
+            }
+          });
+
+          is_commit_safe_tp. template get<s>() = is_commit_safe;
+          is_overwritten_tp. template get<s>() = is_overwritten;
+
+          // The base of an update (or cancelled store) is the youngest older store to its idx. It 
+          // must have its value, and all older stores must have arrived (so none can be missed). 
+          // The base is only taken from the queue: memory is never read on this path.
+          if constexpr (kUseStoreBase) {
+            auto val_entry = store_entries[s][val_bank][stq_tail[s][val_bank]];
+            bool is_update_ready = tag_le(val_entry.tag, min_tag_store) || is_all_store_idx_in;
+            match_t cands[num_sts * QUEUE_SIZE];
+            #pragma unroll
+            for (uint s_other = 0; s_other < num_sts; ++s_other) {
+              #pragma unroll
+              for (uint i = 0; i < QUEUE_SIZE; ++i) {
+                auto other_entry = store_entries[s_other][val_bank][i];
+                const bool is_older_match = (other_entry.idx == val_entry.idx && 
+                                             tag_lt(other_entry.tag, val_entry.tag));
+                is_update_ready &= !(is_older_match && other_entry.waiting_for_val);
+                cands[s_other * QUEUE_SIZE + i] = {is_older_match && !other_entry.is_val_in_mem, 
+                                                   other_entry.tag, s_other, i};
+              }
+            }
+
+            auto base = select_youngest(cands);
+            is_update_ready_tp. template get<s>() = is_update_ready;
+            update_base_tp. template get<s>() = base;
+            update_base_val_tp. template get<s>() = 
+                store_entries_val[base.port][val_bank][base.slot];
+          }
+          if constexpr (kUseWriteCombine) {
+            const int pending_bank = bank_of(idx_tag_pair_store_tp. template get<s>().first);
+            is_drain |= (is_store_idx_pending_tp. template get<s>() && 
+                         store_entries[s][pending_bank][stq_head[s][pending_bank]].idx != -1);
+          }
+        });
+
+        // All store ports allocate and commit their entries in parallel.
+        UnrolledLoop<num_sts>([&](auto s) {
+          // Use shorter names.
+          auto& idx_tag_pair_store = idx_tag_pair_store_tp. template get<s>();
+          auto& is_store_idx_pending = is_store_idx_pending_tp. template get<s>();
+          auto& tag_store = tag_store_tp. template get<s>();
+          auto& num_dirty = num_dirty_tp. template get<s>();
+          auto& pending_commit = pending_commit_tp. template get<s>();
+          auto& is_commit_pending = is_commit_pending_tp. template get<s>();
+
+          // The StoreAck kernel acknowledges the oldest committed stores in every bank of the port.
+          store_ack_t acks;
+          bool ack_pipe_succ = false;
+          if constexpr (kUseAckRetire) 
+            acks = store_ack_pipes:: template PipeAt<s>::read(ack_pipe_succ);
+
+          bool is_space_in_bank[NUM_BANKS];
+          #pragma unroll
+          for (int b = 0; b < NUM_BANKS; ++b)
+            is_space_in_bank[b] = (store_entries[s][b][stq_head[s][b]].idx == -1);
+
+          #pragma unroll
+          for (int b = 0; b < NUM_BANKS; ++b) {
+            #pragma unroll
+            for (storeq_idx_t i = 0; i < QUEUE_SIZE; ++i) {
+              bool is_retiring = false;
+              if constexpr (kUseAckRetire) {
+                is_retiring = ack_pipe_succ && 
+                    ((int(i) + QUEUE_SIZE - int(stq_ack[s][b])) % QUEUE_SIZE) < acks.num_acks[b];
+              } else {
+                // Invalidate idx if count WILL GO to 0 on this iteration.
+                // On every iteration, decrement counter for stores in-flight.
+                is_retiring = (store_entries[s][b][i].countdown < int16_t(1) && 
+                               !store_entries[s][b][i].waiting_for_val && 
+                               !store_entries[s][b][i].is_dirty && 
+                               !store_entries[s][b][i].is_update_base);
+                if (!is_retiring)
+                  store_entries[s][b][i].countdown--;
+              }
+
+              if (is_retiring) {
+                if constexpr (kUseBloomFilter) {
+                  if (store_entries[s][b][i].idx != -1) {
+                    UnrolledLoop<kBloomSize>([&](auto c) {
+                      bloom_delta[c] -= (bloom_hash_0(store_entries[s][b][i].idx) == c);
+                      bloom_delta[c] -= (bloom_hash_1(store_entries[s][b][i].idx) == c);
+                    });
+                  }
+                }
+                store_entries[s][b][i].idx = -1;
+              }
+            }
+
+            if constexpr (kUseAckRetire) {
+              if (ack_pipe_succ) {
+                stq_ack[s][b] = (stq_ack[s][b] + acks.num_acks[b]) % QUEUE_SIZE;
+                i_store_ack_total += acks.num_acks[b];
+              }
+            }
+          }
+
+          // Check for new store_idx requests. The entry is allocated once its bank has space.
+          auto& is_store_end = is_store_end_tp. template get<s>();
+          if (!is_store_idx_pending && !is_store_end) {
+            idx_tag_pair_store = read_st_idx(s, is_store_idx_pending);
+          }
+
+          if (is_store_idx_pending) {
             int idx_store = idx_tag_pair_store.first;
-            tag_store = idx_tag_pair_store.second;
+            const int b = bank_of(idx_store);
+
+            // The end token moves the tag past all loads, so none of them waits for this port.
+            if ((WIDTH > 1 && idx_store == -1) || (END_TOKENS && idx_store == kStoreQueueEnd)) {
+              tag_store = tag_t(idx_tag_pair_store.second);
+#if FPGA_EMULATOR
+              full_tag_store[s] = idx_tag_pair_store.second;
+#endif
+              is_store_end = (END_TOKENS && idx_store == kStoreQueueEnd);
+              is_store_idx_pending = false;
+            } else if (is_space_in_bank[b]) {
+              tag_store = tag_t(idx_tag_pair_store.second);
+#if FPGA_EMULATOR
+              assert_tag_distance(idx_tag_pair_store.second);
+              full_tag_store[s] = idx_tag_pair_store.second;
+              full_entry_tag[s][b][stq_head[s][b]] = idx_tag_pair_store.second;
+#endif
 
-            store_entries[stq_head] = {idx_store, tag_store, true};
-            stq_head = (stq_head+1) % QUEUE_SIZE;
-            i_store_idx++;
+              store_entries[s][b][stq_head[s][b]] = {idx_store, tag_store, true};
+              if constexpr (kUseBloomFilter) {
+                UnrolledLoop<kBloomSize>([&](auto c) {
+                  bloom_delta[c] += (bloom_hash_0(idx_store) == c);
+                  bloom_delta[c] += (bloom_hash_1(idx_store) == c);
+                });
+              }
+              stq_head[s][b] = (stq_head[s][b] + 1) % QUEUE_SIZE;
+              if constexpr (kUseStoreBase || END_TOKENS)
+                i_store_idx_total++;
+              is_store_idx_pending = false;
+            } else if constexpr (kCollectStats) {
+              num_queue_full++;
+            }
+          }
+
+          if constexpr (kUseAckRetire) {
+            if (is_commit_pending) {
+              bool commit_pipe_succ = false;
+              store_commit_pipes:: template PipeAt<s>::write(pending_commit, commit_pipe_succ);
+              is_commit_pending = !commit_pipe_succ;
+            }
+          }
+
+          // Write the oldest dirty entry once the port holds more than WRITE_COMBINE of them. If a 
+          // younger store to the same idx already has its value, then skip the memory write (as for
+          // a cancelled store).
+          if constexpr (kUseWriteCombine) {
+            const int b = write_bank_tp. template get<s>();
+            auto& stq_write_b = stq_write[s][b];
+            bool is_overwritten = is_overwritten_tp. template get<s>();
+            bool is_write_due = (num_dirty > WRITE_COMBINE || is_drain) && 
+                                is_commit_safe_tp. template get<s>();
+            if (num_dirty > 0 && !is_commit_pending && (is_overwritten || is_write_due)) {
+              int idx_write = store_entries[s][b][stq_write_b].idx;
+              const bool is_write = 
+                  !is_overwritten && !store_entries[s][b][stq_write_b].is_cancelled;
+              store_entries[s][b][stq_write_b].is_dirty = false;
+              if constexpr (kUseLoadCache) {
+                if (is_write)
+                  update_load_cache(idx_write, store_entries_val[s][b][stq_write_b]);
+              }
+              if constexpr (kUseAckRetire) {
+                pending_commit = {idx_write, is_write, store_entries_val[s][b][stq_write_b]};
+                bool commit_pipe_succ = false;
+                store_commit_pipes:: template PipeAt<s>::write(pending_commit, commit_pipe_succ);
+                is_commit_pending = !commit_pipe_succ;
+              } else {
+                if (is_write)
+                  store_to_mem(idx_write, store_entries_val[s][b][stq_write_b]);
+                store_entries[s][b][stq_write_b].countdown = 
+                    is_overwritten ? int16_t(0) : int16_t(kStoreLatency);
+              }
+
+              num_dirty--;
+              i_store_commit_total++;
+              stq_write_b = (stq_write_b + 1) % QUEUE_SIZE;
+            }
           }
-        }
 
-        // Only check for store values, once their corresponding index has been received.
-        if (i_store_idx > i_store_val) {
-          bool val_store_pipe_succ = false;
-          value_t val_store = st_val_pipe::read(val_store_pipe_succ);
+          // Only check for store values, once their corresponding index has been allocated.
+          if (is_val_waiting_tp. template get<s>() && 
+              (kUseWriteCombine || (is_commit_safe_tp. template get<s>() && !is_commit_pending)) &&
+              (!kUseStoreBase || is_update_ready_tp. template get<s>())) {
+            bool val_store_pipe_succ = false;
+            st_val_t st_val = read_st_val(s, val_store_pipe_succ);
 
-          if (val_store_pipe_succ) {
-            store_entries_val[stq_tail] = val_store;
-            store_entries[stq_tail].waiting_for_val = false;
-            PipelinedLSU::store(data + store_entries[stq_tail].idx, val_store);
-            store_entries[stq_tail].countdown = int16_t(kLatencyPipelinedLSU);
-            
-            i_store_val++;
-            stq_tail = (stq_tail + 1) % QUEUE_SIZE;
+            if (val_store_pipe_succ) {
+              const int b = val_bank_tp. template get<s>();
+              auto& stq_tail_b = stq_tail[s][b];
+              value_t val_store;
+              bool is_cancelled = false;
+              if constexpr (CANCEL) {
+                val_store = st_val.val;
+                is_cancelled = st_val.is_cancelled;
+              } else {
+                val_store = st_val;
+              }
+              bool is_val_in_mem = false;
+              if constexpr (kUseStoreBase) {
+                const auto base = update_base_tp. template get<s>();
+                const value_t base_val = update_base_val_tp. template get<s>();
+                if constexpr (UPDATE) {
+                  // Without a base in the queue, the compute kernel has already added the memory 
+                  // value returned by the base load.
+                  if (base.valid) {
+                    val_store = value_t(val_store + base_val);
+                    store_entries[base.port][b][base.slot].is_update_base = false;
+                  }
+                } else if (is_cancelled) {
+                  val_store = base_val;
+                  is_val_in_mem = !base.valid;
+                }
+              }
+              if constexpr (kKeepStoreVals)
+                store_entries_val[s][b][stq_tail_b] = val_store;
+              store_entries[s][b][stq_tail_b].waiting_for_val = false;
+              store_entries[s][b][stq_tail_b].is_cancelled = is_cancelled;
+              store_entries[s][b][stq_tail_b].is_val_in_mem = is_val_in_mem;
+              // A cancelled store only holds the value of its idx if it took it from a base.
+              if constexpr (kUseLoadCache && !kUseWriteCombine) {
+                if (!is_cancelled || (kUseStoreBase && !is_val_in_mem))
+                  update_load_cache(store_entries[s][b][stq_tail_b].idx, val_store);
+              }
+              if constexpr (kUseWriteCombine) {
+                store_entries[s][b][stq_tail_b].is_dirty = true;
+                num_dirty++;
+              } else if constexpr (kUseAckRetire) {
+                pending_commit = {store_entries[s][b][stq_tail_b].idx, !is_cancelled, val_store};
+                bool commit_pipe_succ = false;
+                store_commit_pipes:: template PipeAt<s>::write(pending_commit, commit_pipe_succ);
+                is_commit_pending = !commit_pipe_succ;
+              } else {
+                // A cancelled store still counts down, so it does not retire before the older 
+                // stores it may forward from are visible in memory.
+                if (!is_cancelled)
+                  store_to_mem(store_entries[s][b][stq_tail_b].idx, val_store);
+                store_entries[s][b][stq_tail_b].countdown = int16_t(kStoreLatency);
+              }
+              if constexpr (!kUseWriteCombine)
+                i_store_commit_total++;
+              
+              i_store_val_total++;
+              stq_tail_b = (stq_tail_b + 1) % QUEUE_SIZE;
+            }
           }
+        });
+
+        if constexpr (kUseBloomFilter) {
+          #pragma unroll
+          for (uint c = 0; c < kBloomSize; ++c)
+            bloom_filter[c] += bloom_delta[c];
         }
         /* End Store Logic */
 
-        // The end signal supplies the total number of stores sent to the store queue.
-        if (!end_signal)
+        // The end signal supplies the total number of stores sent to the store queue. With 
+        // END_TOKENS, that is the number allocated once every port has ended and all loads (which 
+        // may still wait on a store) have left the load logic.
+        if constexpr (END_TOKENS) {
+          bool is_all_end = true;
+          UnrolledLoop<num_sts>([&](auto s) {
+            is_all_end &= is_store_end_tp. template get<s>();
+          });
+          UnrolledLoop<num_lds>([&](auto k) {
+            is_all_end &= is_load_end_tp. template get<k>() && 
+                          !is_load_pending_tp. template get<k>() &&
+                          !is_load_resolving_tp. template get<k>();
+            #pragma unroll
+            for (uint j = 0; j < kNumSearchStages; ++j)
+              is_all_end &= !ld_stages[k][j].valid;
+          });
+          #pragma unroll
+          for (uint p = 0; p < num_ld_ports; ++p) {
+            #pragma unroll
+            for (uint j = 0; j < WIDTH; ++j)
+              is_all_end &= !is_ld_val_lane_full[p][j];
+          }
+
+          if (is_all_end && !end_signal) {
+            end_signal = true;
+            total_req_stores = i_store_idx_total;
+          }
+        } else if (!end_signal) {
           total_req_stores = end_signal_pipe::read(end_signal);
+        }
+
+        // A batch of a PERSISTENT queue is finished once all its stores are visible in memory: 
+        // they are committed (acknowledged), and kStoreLatency iterations have passed since the 
+        // last commit. Stores of the next batch may already be in the queue and have been counted,
+        // so the totals restart from them. The store port commits in tag order, so the first 
+        // total_req_stores commits are exactly the stores of the batch.
+        if constexpr (PERSISTENT) {
+          const int num_stores_done = kUseAckRetire ? i_store_ack_total : i_store_commit_total;
+          if (end_signal && num_stores_done >= total_req_stores) {
+            if (total_req_stores == kStoreQueueShutdown) {
+              is_shutdown = true;
+            } else if (!kUseAckRetire && batch_countdown > 0) {
+              batch_countdown--;
+            } else {
+              sycl::atomic_fence(sycl::memory_order::seq_cst, sycl::memory_scope::device);
+              num_batches++;
+              num_batches_unpublished++;
+
+              end_signal = false;
+              if constexpr (kUseStoreBase)
+                i_store_idx_total -= total_req_stores;
+              i_store_val_total -= total_req_stores;
+              i_store_commit_total -= total_req_stores;
+              if constexpr (kUseAckRetire)
+                i_store_ack_total -= total_req_stores;
+              total_req_stores = 0;
+              batch_countdown = kStoreLatency;
+              // The host may change data between batches (if it waits for a batch before sending
+              // the next one).
+              #pragma unroll
+              for (uint c = 0; c < kLoadCacheSize; ++c)
+                load_cache[c].idx = -1;
+            }
+          }
+
+          if (num_batches_unpublished > 0) {
+            bool batch_done_pipe_succ = false;
+            StoreQueueBatchDonePipe<KernelId>::write(num_batches - num_batches_unpublished + 1, 
+                                                     batch_done_pipe_succ);
+            if (batch_done_pipe_succ)
+              num_batches_unpublished--;
+          }
+        }
+      }
+
+      if constexpr (kUseAckRetire)
+        store_ack_end_pipe::write(true);
+
+      if constexpr (kUseLoadKernel) {
+        UnrolledLoop<num_lds>([&](auto k) {
+          load_req_pipes:: template PipeAt<k>::write({-1, false, true, value_t()});
+        });
+      }
+
+      if constexpr (kUseOnchipMemory) {
+        for (int i = 0; i < data_size; ++i)
+          data[i] = onchip_data.read(i);
+      }
+
+      if constexpr (kCollectStats) {
+        *stats = {num_iterations, II, num_loads_forwarded, num_loads_from_mem, 
+                  num_loads_from_cache, num_stalls_tag, num_stalls_waiting_for_val, 
+                  num_queue_full};
       }
 
     });
@@ -222,4 +1663,16 @@ event StoreQueue(queue &q, device_ptr<value_t> data) {
   return event;
 }
 
+/// A StoreQueue over the single array data.
+template <typename ld_idx_pipes, typename ld_val_pipes, int num_ld_ports, typename st_idx_pipes,
+          typename st_val_pipes, int num_st_ports, typename end_signal_pipe, 
+          typename Config = StoreQueueDefaults, typename value_t, typename stats_t = std::nullptr_t>
+event StoreQueue(queue &q, device_ptr<value_t> data, stats_t stats = nullptr, 
+                 int data_size = Config::MemoryBackend::kDepth) {
+  static_assert(Config::kNumRegions == 1, "A queue over several regions takes a region_table_t.");
+  return StoreQueue<ld_idx_pipes, ld_val_pipes, num_ld_ports, st_idx_pipes, st_val_pipes, 
+                    num_st_ports, end_signal_pipe, Config>
+      (q, region_table_t<value_t, 1>{{data}}, stats, data_size);
+}
+
 #endif
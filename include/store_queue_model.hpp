@@ -0,0 +1,355 @@
+/*
+Cycle-approximate host model of the StoreQueue in store_queue.hpp.
+
+Runs the same iteration structure as the StoreQueue kernel (load search pipeline, store allocation,
+value acceptance, countdown retirement) on {idx, tag} streams, without SYCL or an FPGA compile.
+Meant for sweeping QUEUE_SIZE and data distributions at full problem sizes before a hardware build.
+The streams are pulled on the fly and the model state is bounded by QUEUE_SIZE, so memory does not
+grow with the problem size.
+*/
+
+#ifndef __STORE_QUEUE_MODEL_HPP__
+#define __STORE_QUEUE_MODEL_HPP__
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "store_queue_trace.hpp"
+
+/// Latencies (in cycles) of the kernels around the modelled StoreQueue.
+struct StoreQueueModelTiming {
+  /// From the StoreQueue iteration that resolves a load to its value reaching the compute kernel
+  /// (loop pipeline depth including the load LSU, plus the ld_val pipe).
+  int load_latency = 40;
+  /// From the compute kernel having every load value a store depends on to the store value being
+  /// readable by the StoreQueue.
+  int compute_latency = 10;
+  /// Iterations until a store is visible in memory (kLatencyPipelinedLSU).
+  int store_latency = 7;
+  /// A run is abandoned after this many iterations without any request making progress.
+  int64_t max_idle_iterations = 100000;
+};
+
+/// The requests of one ld/st port, in the order the address producer sends them. Writes the next
+/// request to req, or returns false once the stream has ended. Generated or read from a mapped
+/// trace on the fly, so that no stream is held in memory.
+using StoreQueueModelStream = std::function<bool(idx_tag_t &req)>;
+
+/// Result of a StoreQueueModel run. The counters have the meaning of the StoreQueueStats ones.
+struct StoreQueueModelStats {
+  int64_t num_cycles;
+  int64_t num_iterations;
+  int64_t num_loads;
+  int64_t num_stores;
+  int64_t num_loads_forwarded;
+  int64_t num_loads_from_mem;
+  int64_t num_stalls_tag;
+  int64_t num_stalls_waiting_for_val;
+  int64_t num_queue_full;
+  // The oldest store of a port could be committed, but the compute kernel has not yet sent its
+  // value (the load -> compute -> store round trip).
+  int64_t num_stalls_store_val;
+  // The streams cannot finish (e.g. a load tag that no store tag ever reaches).
+  bool is_deadlock;
+
+  void print() const {
+    std::cout << "StoreQueue model:\n"
+              << "  Cycles: " << num_cycles << (is_deadlock ? " (deadlock)" : "") << "\n"
+              << "  Iterations: " << num_iterations << "\n"
+              << "  Loads forwarded: " << num_loads_forwarded << "\n"
+              << "  Loads from memory: " << num_loads_from_mem << "\n"
+              << "  Load stalls, tag not reached: " << num_stalls_tag << "\n"
+              << "  Load stalls, store waiting_for_val: " << num_stalls_waiting_for_val << "\n"
+              << "  Store idx stalls, queue full: " << num_queue_full << "\n"
+              << "  Store stalls, value not yet computed: " << num_stalls_store_val << "\n";
+  }
+};
+
+/// Models a StoreQueue on ld_streams[k] / st_streams[s], the requests of every ld/st port. 
+/// QUEUE_SIZE, FORWARDING, SEARCH_WIDTH and II stand for the kQueueSize, kForwarding, kSearchWidth 
+/// and kII knobs of its Config, and all other knobs keep their StoreQueueDefaults. Tags are plain 
+/// ints, not wrapped. Every stream is read once, one request ahead of the queue.
+///
+/// Modelled: load and store ports, the search pipeline of SEARCH_WIDTH entries per stage,
+/// forwarding (or waiting for the store to retire), countdown retirement, the cross-port commit
+/// order, and the II of the main loop. The producer is assumed to never stall the queue, and the
+/// compute kernel to consume load values at once. It sends a store value compute_latency cycles
+/// after receiving every load value with a smaller tag (it is in order). A store port whose stream
+/// is exhausted does not hold back younger loads (as with END_TOKENS).
+template <int num_ld_ports, int num_st_ports, int QUEUE_SIZE = 8, bool FORWARDING = true,
+          int SEARCH_WIDTH = 4, int II = 1>
+StoreQueueModelStats StoreQueueModel(std::vector<StoreQueueModelStream> ld_streams,
+                                     std::vector<StoreQueueModelStream> st_streams,
+                                     StoreQueueModelTiming timing = {}) {
+  constexpr int kNumSearchStages = (QUEUE_SIZE + SEARCH_WIDTH - 1) / SEARCH_WIDTH;
+  // Every resolved load kept is the last one before the tag of a store waiting for its value, 
+  // except the youngest (see resolve_load).
+  constexpr int kMaxResolvedLoads = num_st_ports * QUEUE_SIZE + 2;
+
+  struct store_entry {
+    bool valid;
+    int idx;
+    int tag;
+    bool waiting_for_val;
+    int countdown;
+  };
+  struct search_stage {
+    bool valid;
+    int idx;
+    int tag;
+    bool has_match;
+    int max_tag;
+    int match_port;
+    int match_slot;
+  };
+  struct resolved_load {
+    int tag;
+    int64_t iter;
+  };
+
+  StoreQueueModelStats stats = {};
+
+  // Store port state.
+  store_entry store_entries[num_st_ports][QUEUE_SIZE] = {};
+  int stq_head[num_st_ports] = {};
+  int stq_tail[num_st_ports] = {};
+  int tag_store[num_st_ports] = {};
+  // The next store idx of the port (read one ahead), if its stream has not ended.
+  idx_tag_t store_req[num_st_ports];
+  bool is_store_idx_pending[num_st_ports] = {};
+
+  // Load port state.
+  search_stage ld_stages[num_ld_ports][kNumSearchStages] = {};
+  search_stage resolve_stage[num_ld_ports] = {};
+  bool is_load_resolving[num_ld_ports] = {};
+  idx_tag_t load_req[num_ld_ports];
+  bool is_load_pending[num_ld_ports] = {};
+  // The resolved loads a store waiting for its value may depend on, in tag order.
+  resolved_load resolved_loads[num_ld_ports][kMaxResolvedLoads];
+  int num_resolved_loads[num_ld_ports] = {};
+
+  for (int k = 0; k < num_ld_ports; ++k)
+    is_load_pending[k] = ld_streams[k](load_req[k]);
+  for (int s = 0; s < num_st_ports; ++s)
+    is_store_idx_pending[s] = st_streams[s](store_req[s]);
+
+  // Does a store waiting for its value have a tag in (tag_lo, tag_hi].
+  auto is_store_waiting_in = [&](const int tag_lo, const int tag_hi) {
+    for (int s = 0; s < num_st_ports; ++s) {
+      for (int i = 0; i < QUEUE_SIZE; ++i) {
+        auto &entry = store_entries[s][i];
+        if (entry.valid && entry.waiting_for_val && entry.tag > tag_lo && entry.tag <= tag_hi)
+          return true;
+      }
+    }
+    return false;
+  };
+  // A store waiting for its value only depends on the youngest resolved load of a port with a
+  // smaller tag. A store not yet allocated has a larger tag than any load that could resolve (which
+  // waits for min_tag_store). So a resolved load is only kept while a waiting store has a tag
+  // between it and the next resolved load: at most one load per waiting store, plus the youngest.
+  auto resolve_load = [&](const int k, const int tag, const int64_t iter) {
+    auto *loads = resolved_loads[k];
+    int &num_loads = num_resolved_loads[k];
+    loads[num_loads++] = {tag, iter};
+    int num_kept = 0;
+    for (int i = 0; i < num_loads; ++i) {
+      if (i == num_loads - 1 || is_store_waiting_in(loads[i].tag, loads[i + 1].tag))
+        loads[num_kept++] = loads[i];
+    }
+    num_loads = num_kept;
+  };
+  // The tag of the oldest load of the port not yet resolved, or INT_MAX once all have been.
+  auto oldest_unresolved_tag = [&](const int k) {
+    if (is_load_resolving[k])
+      return resolve_stage[k].tag;
+    for (int j = kNumSearchStages - 1; j >= 0; --j) {
+      if (ld_stages[k][j].valid)
+        return ld_stages[k][j].tag;
+    }
+    return is_load_pending[k] ? load_req[k].tag : INT_MAX;
+  };
+
+  int64_t num_loads_done = 0, num_stores_done = 0;
+  // Requests that entered the queue, or were completed.
+  auto num_steps_done = [&]() { return stats.num_loads + stats.num_stores + num_loads_done + 
+                                       num_stores_done; };
+
+  int64_t iter = 0;
+  int64_t last_progress_iter = 0;
+  while (true) {
+    // Done once every stream has ended and all its requests have completed.
+    bool is_done = (num_loads_done == stats.num_loads && num_stores_done == stats.num_stores);
+    for (int k = 0; k < num_ld_ports; ++k)
+      is_done &= !is_load_pending[k];
+    for (int s = 0; s < num_st_ports; ++s)
+      is_done &= !is_store_idx_pending[s];
+    if (is_done)
+      break;
+
+    const int64_t cycle = iter * II;
+    const int64_t num_steps_before = num_steps_done();
+
+    int min_tag_store = INT_MAX;
+    for (int s = 0; s < num_st_ports; ++s) {
+      const bool is_port_done = !is_store_idx_pending[s];
+      min_tag_store = std::min(min_tag_store, is_port_done ? INT_MAX : tag_store[s]);
+    }
+
+    /* Load logic */
+    for (int k = 0; k < num_ld_ports; ++k) {
+      if (is_load_resolving[k]) {
+        auto &stage = resolve_stage[k];
+        bool is_match_in_stq = false;
+        bool is_forwarding = false;
+        if (stage.has_match) {
+          auto &st_entry = store_entries[stage.match_port][stage.match_slot];
+          is_match_in_stq = (st_entry.valid && st_entry.idx == stage.idx &&
+                             st_entry.tag == stage.max_tag);
+          is_forwarding = is_match_in_stq && !st_entry.waiting_for_val && FORWARDING;
+          stats.num_loads_forwarded += is_forwarding;
+          stats.num_stalls_waiting_for_val += (is_match_in_stq && !is_forwarding);
+        }
+        stats.num_loads_from_mem += !is_match_in_stq;
+
+        if (is_forwarding || !is_match_in_stq) {
+          resolve_load(k, stage.tag, iter);
+          is_load_resolving[k] = false;
+          num_loads_done++;
+        }
+      }
+
+      if (!is_load_resolving[k]) {
+        for (int j = kNumSearchStages - 1; j >= 0; --j) {
+          auto stage = ld_stages[k][j];
+          for (int s = 0; s < num_st_ports; ++s) {
+            for (int w = 0; w < SEARCH_WIDTH; ++w) {
+              const int i = j * SEARCH_WIDTH + w;
+              if (i >= QUEUE_SIZE)
+                continue;
+              auto &st_entry = store_entries[s][i];
+              if (st_entry.valid && st_entry.idx == stage.idx && st_entry.tag <= stage.tag &&
+                  (!stage.has_match || stage.max_tag < st_entry.tag)) {
+                stage.has_match = true;
+                stage.max_tag = st_entry.tag;
+                stage.match_port = s;
+                stage.match_slot = i;
+              }
+            }
+          }
+
+          if (j == kNumSearchStages - 1) {
+            resolve_stage[k] = stage;
+            is_load_resolving[k] = stage.valid;
+          } else {
+            ld_stages[k][j + 1] = stage;
+          }
+        }
+        ld_stages[k][0].valid = false;
+      }
+
+      if (is_load_pending[k]) {
+        const auto req = load_req[k];
+        if (req.tag > min_tag_store) {
+          stats.num_stalls_tag++;
+        } else if (!ld_stages[k][0].valid) {
+          ld_stages[k][0] = {true, req.idx, req.tag, false, 0, 0, 0};
+          is_load_pending[k] = ld_streams[k](load_req[k]);
+          stats.num_loads++;
+        }
+      }
+    }
+
+    /* Store logic */
+    // The oldest store waiting for its value must not overtake an older store to the same idx on
+    // another port. Decided before any port commits.
+    bool is_commit_safe[num_st_ports];
+    for (int s = 0; s < num_st_ports; ++s) {
+      auto &tail_entry = store_entries[s][stq_tail[s]];
+      is_commit_safe[s] = true;
+      for (int s_other = 0; s_other < num_st_ports; ++s_other) {
+        for (int i = 0; i < QUEUE_SIZE; ++i) {
+          auto &other_entry = store_entries[s_other][i];
+          if (s_other != s && other_entry.valid && other_entry.waiting_for_val &&
+              other_entry.idx == tail_entry.idx && other_entry.tag < tail_entry.tag)
+            is_commit_safe[s] = false;
+        }
+      }
+    }
+
+    for (int s = 0; s < num_st_ports; ++s) {
+      const bool is_space = !store_entries[s][stq_head[s]].valid;
+      // As in the kernel, a value is only accepted for a store allocated in an earlier iteration.
+      auto &tail_entry = store_entries[s][stq_tail[s]];
+      const bool is_val_waiting = tail_entry.valid && tail_entry.waiting_for_val;
+
+      for (int i = 0; i < QUEUE_SIZE; ++i) {
+        auto &entry = store_entries[s][i];
+        if (entry.valid && entry.countdown < 1 && !entry.waiting_for_val)
+          entry.valid = false;
+        else
+          entry.countdown--;
+      }
+
+      if (is_store_idx_pending[s]) {
+        if (is_space) {
+          const auto req = store_req[s];
+          store_entries[s][stq_head[s]] = {true, req.idx, req.tag, true, 0};
+          stq_head[s] = (stq_head[s] + 1) % QUEUE_SIZE;
+          tag_store[s] = req.tag;
+          is_store_idx_pending[s] = st_streams[s](store_req[s]);
+          stats.num_stores++;
+        } else {
+          stats.num_queue_full++;
+        }
+      }
+
+      if (is_val_waiting && is_commit_safe[s]) {
+        // The compute kernel sends the value once it has received all loads preceding the store.
+        const int tag = tail_entry.tag;
+        bool is_val_computed = true;
+        int64_t val_cycle = 0;
+        for (int k = 0; k < num_ld_ports; ++k) {
+          if (oldest_unresolved_tag(k) < tag) {
+            is_val_computed = false;
+            continue;
+          }
+          for (int i = num_resolved_loads[k] - 1; i >= 0; --i) {
+            if (resolved_loads[k][i].tag < tag) {
+              val_cycle = std::max(val_cycle, resolved_loads[k][i].iter * II +
+                                              timing.load_latency + timing.compute_latency);
+              break;
+            }
+          }
+        }
+
+        if (is_val_computed && val_cycle <= cycle) {
+          tail_entry.waiting_for_val = false;
+          tail_entry.countdown = timing.store_latency;
+          stq_tail[s] = (stq_tail[s] + 1) % QUEUE_SIZE;
+          num_stores_done++;
+        } else {
+          stats.num_stalls_store_val++;
+        }
+      }
+    }
+
+    iter++;
+    if (num_steps_done() != num_steps_before)
+      last_progress_iter = iter;
+    if (iter - last_progress_iter > timing.max_idle_iterations) {
+      stats.is_deadlock = true;
+      break;
+    }
+  }
+
+  stats.num_iterations = iter;
+  stats.num_cycles = iter * II + timing.load_latency;
+  return stats;
+}
+
+#endif
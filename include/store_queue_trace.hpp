@@ -0,0 +1,129 @@
+/*
+Binary traces of the {idx, tag} request streams sent to a StoreQueue.
+
+A trace holds the requests of every ld/st port in the order the address producers sent them. It is
+written by benchmarks built with -DSTOREQ_TRACE=1 (see StoreQueueTraceAlloc in store_queue.hpp) and
+replayed into the StoreQueue (trace_replay/) or into the host model (store_queue_model/).
+*/
+
+#ifndef __STORE_QUEUE_TRACE_HPP__
+#define __STORE_QUEUE_TRACE_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// No <unistd.h>: its pipe() would clash with sycl::pipe in the benchmarks.
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/// An {idx, tag} request, as sent on an ld/st idx pipe of a StoreQueue (same layout as pair_t).
+struct idx_tag_t { int idx; int tag; };
+
+/// File layout, in host byte order. All fields are naturally aligned, so a mapped file is read in
+/// place:
+///   StoreQueueTraceHeader
+///   int64_t num_reqs[num_ld_ports + num_st_ports]
+///   idx_tag_t reqs[]     (the requests of load port 0, 1, ..., then of store port 0, 1, ...)
+struct StoreQueueTraceHeader {
+  char magic[8];
+  int32_t version;
+  int32_t num_ld_ports;
+  int32_t num_st_ports;
+  int32_t reserved;
+};
+constexpr char kStoreQueueTraceMagic[8] = "SQTRACE";
+constexpr int32_t kStoreQueueTraceVersion = 1;
+
+/// Writes the ld/st streams to filename. Returns false if the file cannot be written.
+inline bool StoreQueueTraceWrite(const char *filename,
+                                 const std::vector<std::vector<idx_tag_t>> &ld_streams,
+                                 const std::vector<std::vector<idx_tag_t>> &st_streams) {
+  FILE *file = fopen(filename, "wb");
+  if (!file)
+    return false;
+
+  StoreQueueTraceHeader header = {};
+  memcpy(header.magic, kStoreQueueTraceMagic, sizeof(header.magic));
+  header.version = kStoreQueueTraceVersion;
+  header.num_ld_ports = ld_streams.size();
+  header.num_st_ports = st_streams.size();
+  bool is_ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+  for (auto *streams : {&ld_streams, &st_streams}) {
+    for (auto &stream : *streams) {
+      int64_t num_reqs = stream.size();
+      is_ok &= (fwrite(&num_reqs, sizeof(num_reqs), 1, file) == 1);
+    }
+  }
+  for (auto *streams : {&ld_streams, &st_streams}) {
+    for (auto &stream : *streams)
+      is_ok &= (fwrite(stream.data(), sizeof(idx_tag_t), stream.size(), file) == stream.size());
+  }
+
+  is_ok &= (fclose(file) == 0);
+  return is_ok;
+}
+
+/// A trace file mapped read-only into memory. Port p is load port p for p < num_ld_ports, and store
+/// port p - num_ld_ports otherwise. is_valid() is false if the file could not be mapped or is not a
+/// trace.
+class StoreQueueTraceMap {
+ public:
+  explicit StoreQueueTraceMap(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+      return;
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0 && st.st_size >= int64_t(sizeof(StoreQueueTraceHeader))) {
+      size_ = st.st_size;
+      void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+      base_ = (addr == MAP_FAILED) ? nullptr : static_cast<const char *>(addr);
+    }
+    fclose(file);
+    if (base_)
+      parse();
+  }
+  ~StoreQueueTraceMap() {
+    if (base_)
+      munmap(const_cast<char *>(base_), size_);
+  }
+  StoreQueueTraceMap(const StoreQueueTraceMap &) = delete;
+  StoreQueueTraceMap &operator=(const StoreQueueTraceMap &) = delete;
+
+  bool is_valid() const { return is_valid_; }
+  int num_ld_ports() const { return header_->num_ld_ports; }
+  int num_st_ports() const { return header_->num_st_ports; }
+  int64_t num_reqs(int port) const { return num_reqs_[port]; }
+  const idx_tag_t *reqs(int port) const { return reqs_[port]; }
+
+ private:
+  void parse() {
+    header_ = reinterpret_cast<const StoreQueueTraceHeader *>(base_);
+    if (memcmp(header_->magic, kStoreQueueTraceMagic, sizeof(header_->magic)) != 0 ||
+        header_->version != kStoreQueueTraceVersion || header_->num_ld_ports < 0 ||
+        header_->num_st_ports < 0)
+      return;
+
+    const int num_ports = header_->num_ld_ports + header_->num_st_ports;
+    size_t offset = sizeof(StoreQueueTraceHeader) + num_ports * sizeof(int64_t);
+    if (offset > size_)
+      return;
+    num_reqs_ = reinterpret_cast<const int64_t *>(base_ + sizeof(StoreQueueTraceHeader));
+    for (int p = 0; p < num_ports; ++p) {
+      reqs_.push_back(reinterpret_cast<const idx_tag_t *>(base_ + offset));
+      offset += num_reqs_[p] * sizeof(idx_tag_t);
+    }
+    is_valid_ = (offset == size_);
+  }
+
+  const char *base_ = nullptr;
+  size_t size_ = 0;
+  bool is_valid_ = false;
+  const StoreQueueTraceHeader *header_ = nullptr;
+  const int64_t *num_reqs_ = nullptr;
+  std::vector<const idx_tag_t *> reqs_;
+};  // class StoreQueueTraceMap
+
+#endif
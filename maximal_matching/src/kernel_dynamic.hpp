@@ -16,8 +16,21 @@ using namespace sycl;
   #define Q_SIZE 8
 #endif
 
+/// The StoreQueue of the kernel: Q_SIZE entries, with or without forwarding, and in-band end
+/// tokens. The tag only steps with a matched edge, and the Calculation kernel waits for the loads
+/// of an edge, so the tags in flight span the 64-deep store idx pipes and the queue. 12-bit tags 
+/// (with a wide margin for the real pipe depths) replace 32-bit ones.
+template <bool FORWARDING>
+struct StoreQueueConfig : StoreQueueDefaults {
+  static constexpr int kQueueSize = Q_SIZE;
+  static constexpr bool kForwarding = FORWARDING;
+  static constexpr int kMaxTagDistance = 1024;
+  static constexpr bool kEndTokens = true;
+};
+
 double maximal_matching_kernel(queue &q, const std::vector<int> &h_edges, std::vector<int> &h_vertices,
-                               int *h_out, const int num_edges) {
+                               int *h_out, const int num_edges, 
+                               StoreQueueStats *h_storeq_stats = nullptr) {
   #if dynamic_no_forward_sched
   constexpr bool IS_FORWARDING_Q = false;
   std::cout << "Dynamic (no forward) HLS\n";
@@ -32,6 +45,8 @@ double maximal_matching_kernel(queue &q, const std::vector<int> &h_edges, std::v
 
   constexpr int kNumStoreOps = 2;
   constexpr int kNumLdPipes = 2;
+  // The u and v stores of an iteration go through separate store ports, so both commit in parallel.
+  constexpr int kNumStPipes = kNumStoreOps;
   
   using idx_ld_pipes = PipeArray<class idx_ld_pipe_class, pair_t, 64, kNumLdPipes>;
   using val_ld_pipes = PipeArray<class val_ld_pipe_class, int, 64, kNumLdPipes>;
@@ -53,10 +68,8 @@ double maximal_matching_kernel(queue &q, const std::vector<int> &h_edges, std::v
   using u_store_val_pipe = pipe<class u_store_val_pipe_class, int, 64>;
   using v_store_val_pipe = pipe<class v_store_val_pipe_class, int, 64>;
 
-  using idx_st_pipe = pipe<class idx_st_pipe_class, pair_t, 64>;
-  using val_st_pipe = pipe<class val_st_pipe_class, int, 64>;
-
-  using end_storeq_signal_pipe = pipe<class end_lsq_signal_pipe_class, int>;
+  using idx_st_pipes = PipeArray<class idx_st_pipe_class, pair_t, 64, kNumStPipes>;
+  using val_st_pipes = PipeArray<class val_st_pipe_class, int, 64, kNumStPipes>;
   
   using val_merge_pred_pipe = pipe<class val_merge_pred_class, bool, 64>;
 
@@ -131,8 +144,13 @@ double maximal_matching_kernel(queue &q, const std::vector<int> &h_edges, std::v
   // });
 
   
-  StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipe, val_st_pipe, 
-             end_storeq_signal_pipe, Q_SIZE> (q, device_ptr<int>(vertices));
+  // The end of the requests is sent in-band (END_TOKENS), so there is no end signal pipe and the 
+  // Calculation kernel does not need to count its predicated stores.
+  auto storeq_stats = StoreQueueStatsAlloc(q);
+  auto storeqEvent = 
+      StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipes, val_st_pipes, kNumStPipes,
+                 void, StoreQueueConfig<IS_FORWARDING_Q>>
+                     (q, device_ptr<int>(vertices), storeq_stats);
 
 
   // q.submit([&](handler &hnd) {
@@ -180,11 +198,12 @@ double maximal_matching_kernel(queue &q, const std::vector<int> &h_edges, std::v
   //   });
   // });
 
+  // The end tokens are not recorded.
+  auto storeq_trace = StoreQueueTraceAlloc(q, kNumLdPipes, kNumStPipes, num_edges);
   auto event = q.submit([&](handler &hnd) {
     hnd.single_task<class Calculation>([=]() [[intel::kernel_args_restrict]] {
       int i = 0;
       int out_res = 0;
-      int total_req_stores = 0;
 
       int tag = 0;
       
@@ -197,6 +216,8 @@ double maximal_matching_kernel(queue &q, const std::vector<int> &h_edges, std::v
 
         u_load_pipe::write({u, tag});
         v_load_pipe::write({v, tag});
+        StoreQueueTraceLoad(storeq_trace, 0, {u, tag});
+        StoreQueueTraceLoad(storeq_trace, 1, {v, tag});
         
         auto vertex_u = vertex_u_pipe::read();
         auto vertex_v = vertex_v_pipe::read();
@@ -205,15 +226,16 @@ double maximal_matching_kernel(queue &q, const std::vector<int> &h_edges, std::v
         if ((vertex_u < 0) && (vertex_v < 0)) {
           // idx_tag_0.first = u;
           // idx_tag_1.first = v;
+          // Both stores belong to the same iteration, so they share a tag.
           tag++;
-          idx_st_pipe::write({u, tag});
-          val_st_pipe::write(v);
+          idx_st_pipes::PipeAt<0>::write({u, tag});
+          val_st_pipes::PipeAt<0>::write(v);
 
-          tag++;
-          idx_st_pipe::write({v, tag});
-          val_st_pipe::write(u);
+          idx_st_pipes::PipeAt<1>::write({v, tag});
+          val_st_pipes::PipeAt<1>::write(u);
+          StoreQueueTraceStore(storeq_trace, 0, {u, tag});
+          StoreQueueTraceStore(storeq_trace, 1, {v, tag});
 
-          total_req_stores += 2;
           out_res += 1;
         }
 
@@ -221,15 +243,21 @@ double maximal_matching_kernel(queue &q, const std::vector<int> &h_edges, std::v
       }
 
       // val_merge_pred_pipe::write(0);
-      end_storeq_signal_pipe::write(total_req_stores);
+      u_load_pipe::write({kStoreQueueEnd, tag});
+      v_load_pipe::write({kStoreQueueEnd, tag});
+      idx_st_pipes::PipeAt<0>::write({kStoreQueueEnd, tag + 1});
+      idx_st_pipes::PipeAt<1>::write({kStoreQueueEnd, tag + 1});
 
       *out = out_res;
     });
   });
 
   event.wait();
+  storeqEvent.wait();
   q.memcpy(h_vertices.data(), vertices, sizeof(h_vertices[0]) * h_vertices.size()).wait();
   q.memcpy(h_out, out, sizeof(h_out[0])).wait();
+  StoreQueueStatsCopyAndFree(storeq_stats, h_storeq_stats, q);
+  StoreQueueTraceSaveAndFree(storeq_trace, "maximal_matching.sqtrace", q);
 
   auto start = event.get_profiling_info<info::event_profiling::command_start>();
   auto end = event.get_profiling_info<info::event_profiling::command_end>();
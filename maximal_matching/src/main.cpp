@@ -15,6 +15,7 @@
 #endif
 
 #include "tables.hpp"
+#include "benchmark_harness.hpp"
 
 using namespace sycl;
 
@@ -75,21 +76,9 @@ int maximal_matching_cpu(const std::vector<int> &edges, std::vector<int> &vertic
   return out;
 }
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 int main(int argc, char *argv[]) {
+  BenchmarkHarness harness("maximal_matching", argc, argv);
+
   // Get A_SIZE and forward/no-forward from args.
   // defaulats
   uint NUM_EDGES = 64;
@@ -112,21 +101,13 @@ int main(int argc, char *argv[]) {
     std::cout << "Incorrect argv.\nUsage:\n";
     std::cout << "  ./mm [ARRAY_SIZE] [data_distribution (0/1/2)] [PERCENTAGE (only for data_distr 2)]\n";
     std::cout << "    0 - all_wait, 1 - no_wait, 2 - PERCENTAGE wait\n";
+    std::cout << "    [--warmup=N] [--repeats=N] [--json=FILE] (see benchmark_harness.hpp)\n";
     std::terminate();
   }
 
-#if FPGA_EMULATOR
-  ext::intel::fpga_emulator_selector d_selector;
-#elif FPGA
-  ext::intel::fpga_selector d_selector;
-#else
-  default_selector d_selector;
-#endif
   try {
-    // Enable profiling.
-    property_list properties{property::queue::enable_profiling()};
-    queue q(d_selector, exception_handler, properties);
-    queue q2(d_selector, exception_handler, properties);
+    queue q = harness.make_queue();
+    queue q2 = harness.make_queue();
 
     // Print out the device information used for the kernel code.
     std::cout << "Running on device: " << q.get_device().get_info<info::device::name>() << "\n";
@@ -143,20 +124,34 @@ int main(int argc, char *argv[]) {
     std::vector<int> vertices_cpu(NUM_EDGES*2);
     std::copy(vertices.begin(), vertices.end(), vertices_cpu.begin());
 
-    auto start = std::chrono::steady_clock::now();
-    double kernel_time = 0;
-
     int out = 0;
 
-    kernel_time = maximal_matching_kernel(q, edges, vertices, &out, NUM_EDGES);
+    // The kernel updates vertices in place, every run starts from the initial ones (still in
+    // vertices_cpu).
+    auto reset = [&]() {
+      std::copy(vertices_cpu.begin(), vertices_cpu.end(), vertices.begin());
+      out = 0;
+    };
+    #if STOREQ_STATS && !static_sched
+      StoreQueueStats storeq_stats;
+      harness.run(NUM_EDGES, reset, [&]() {
+        return maximal_matching_kernel(q, edges, vertices, &out, NUM_EDGES, &storeq_stats);
+      });
+    #else
+      harness.run(NUM_EDGES, reset,
+                  [&]() { return maximal_matching_kernel(q, edges, vertices, &out, NUM_EDGES); });
+    #endif
 
     // Wait for all work to finish.
     q.wait();
 
-    std::cout << "\nKernel time (ms): " << kernel_time << "\n";
+    #if STOREQ_STATS && !static_sched
+      storeq_stats.print();
+    #endif
 
     int out_cpu = maximal_matching_cpu(edges, vertices_cpu, NUM_EDGES);
-    if (out == out_cpu) {
+    const bool is_passed = (out == out_cpu);
+    if (is_passed) {
       std::cout << "Passed\n";
     }
     else {
@@ -164,10 +159,7 @@ int main(int argc, char *argv[]) {
       std::cout << "  out fpga = " <<  out << "\n";
       std::cout << "  out cpu = " <<  out_cpu << "\n";
     }
-
-    auto stop = std::chrono::steady_clock::now();
-    double total_time = (std::chrono::duration<double>(stop - start)).count() * 1000.0;
-    // std::cout << "Total time (ms): " << total_time << "\n";
+    harness.report(is_passed);
   } catch (exception const &e) {
     std::cout << "An exception was caught.\n";
     std::terminate();
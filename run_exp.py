@@ -5,6 +5,7 @@ import csv
 import time
 from pathlib import Path
 from build_all import Q_SIZES_DYNAMIC, KERNELS
+from harness_utils import harness_args, get_harness_summary
 
 
 EXP_DATA_DIR = 'exp_data/'
@@ -30,11 +31,14 @@ DATA_DISTRIBUTIONS = {
 }
 SIM_CYCLES_FILE = 'simulation_raw.json'
 TMP_FILE = f'.tmp_run_exp{str(time.time())[-5:]}.txt'
+TMP_JSON_FILE = TMP_FILE.replace('.txt', '.json')
 
 
 def run_bin(bin, a_size, distr=0, percentage=0):
     print(f'> {bin} : ', end='')
-    os.system(f'{bin} {a_size} {distr} {percentage} > {TMP_FILE}')
+    if os.path.exists(TMP_JSON_FILE):
+        os.remove(TMP_JSON_FILE)
+    os.system(f'{bin} {a_size} {distr} {percentage} {harness_args(bin, TMP_JSON_FILE)} > {TMP_FILE}')
 
     stdout = ''
     with open(TMP_FILE, 'r') as f:
@@ -51,11 +55,12 @@ def run_bin(bin, a_size, distr=0, percentage=0):
             return int(match.group(1))
     else: 
         # Get time
-        match = re.search(r'Kernel time \(ms\): (\d+\.\d+|\d+)', stdout)
-        if match:
+        summary = get_harness_summary(TMP_JSON_FILE)
+        if summary:
+            kernel_time = summary['kernel_time_ms']['median']
             if not  not 'emu' in bin:
-                print(f'{float(match.group(1))}')
-            return float(match.group(1))
+                print(f'{kernel_time} (p95 {summary["kernel_time_ms"]["p95"]})')
+            return kernel_time
 
 
 if __name__ == '__main__':
@@ -106,4 +111,4 @@ if __name__ == '__main__':
                 os.system(f'rm -r {EXP_DATA_DIR}/{kernel}/{SUB_DIR}')
         
 
-    os.system(f'rm {TMP_FILE}')
+    os.system(f'rm -f {TMP_FILE} {TMP_JSON_FILE}')
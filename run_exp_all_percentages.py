@@ -7,11 +7,13 @@ from scipy.stats import gmean
 from pathlib import Path
 
 from build_all import KERNELS, Q_SIZES
+from harness_utils import harness_args, get_harness_summary
 
 
 EXP_DATA_DIR = 'exp_data/'
 SIM_CYCLES_FILE = 'simulation_raw.json'
 TMP_FILE = f'.tmp_run_exp{str(time.time())[-5:]}.txt'
+TMP_JSON_FILE = TMP_FILE.replace('.txt', '.json')
 
 kernel_asize_pairs = {
     'histogram' : 1000000,
@@ -49,7 +51,9 @@ def run_bin(bin, a_size, percentage=0):
     else: # percentage wait
         bin_invoc = f'{bin} {a_size} 2 {percentage}'
 
-    os.system(f'{bin_invoc} > {TMP_FILE}')
+    if os.path.exists(TMP_JSON_FILE):
+        os.remove(TMP_JSON_FILE)
+    os.system(f'{bin_invoc} {harness_args(bin, TMP_JSON_FILE)} > {TMP_FILE}')
     stdout = ''
     with open(TMP_FILE, 'r') as f:
         stdout = str(f.read())
@@ -65,10 +69,11 @@ def run_bin(bin, a_size, percentage=0):
             return int(match.group(1))
     else: 
         # Get time
-        match = re.search(r'Kernel time \(ms\): (\d+\.\d+|\d+)', stdout)
-        if match:
-            print(f'{float(match.group(1))}')
-            return float(match.group(1))
+        summary = get_harness_summary(TMP_JSON_FILE)
+        if summary:
+            kernel_time = summary['kernel_time_ms']['median']
+            print(f'{kernel_time} (p95 {summary["kernel_time_ms"]["p95"]})')
+            return kernel_time
     
     return 1
 
@@ -178,6 +183,6 @@ if __name__ == '__main__':
     print(f'\nResults saved to {res_file}')
 
 
-    os.system(f'rm {TMP_FILE}')
+    os.system(f'rm -f {TMP_FILE} {TMP_JSON_FILE}')
 
 
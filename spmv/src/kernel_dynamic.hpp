@@ -21,10 +21,39 @@ using namespace fpga_tools;
   #define Q_SIZE 8
 #endif
 
+// Buckets of the StoreQueue Bloom filter (0 disables it).
+#ifndef Q_BLOOM_SIZE
+  #define Q_BLOOM_SIZE 0
+#endif
+
 constexpr uint STORE_Q_SIZE = Q_SIZE;
 
-double spmv_kernel(queue &q, std::vector<float> &h_matrix, const std::vector<int> &h_row,
-                   const std::vector<int> &h_col, const std::vector<float> &h_a, const int M) {
+// Every StoreQueue of the kernel needs its own KernelId.
+class MatrixStoreQueueId;
+class ColSumStoreQueueId;
+
+/// The StoreQueue of the matrix: Q_SIZE entries, with or without forwarding, and a Bloom filter 
+/// of Q_BLOOM_SIZE buckets.
+template <bool FORWARDING>
+struct StoreQueueConfig : StoreQueueDefaults {
+  static constexpr int kQueueSize = Q_SIZE;
+  static constexpr bool kForwarding = FORWARDING;
+  static constexpr int kBloomSize = Q_BLOOM_SIZE;
+  using KernelId = MatrixStoreQueueId;
+};
+
+/// The StoreQueue of the column sums, which runs next to the one of the matrix.
+template <bool FORWARDING>
+struct ColSumStoreQueueConfig : StoreQueueDefaults {
+  static constexpr int kQueueSize = Q_SIZE;
+  static constexpr bool kForwarding = FORWARDING;
+  using KernelId = ColSumStoreQueueId;
+};
+
+double spmv_kernel(queue &q, std::vector<float> &h_matrix, std::vector<float> &h_col_sum, 
+                   const std::vector<int> &h_row, const std::vector<int> &h_col, 
+                   const std::vector<float> &h_a, const int M, 
+                   StoreQueueStats *h_storeq_stats = nullptr) {
 #if dynamic_no_forward_sched
   constexpr bool IS_FORWARDING_Q = false;
   std::cout << "Dynamic (no forward) HLS\n";
@@ -34,21 +63,30 @@ double spmv_kernel(queue &q, std::vector<float> &h_matrix, const std::vector<int
 #endif
 
   auto matrix = toDevice(h_matrix, q);
+  auto col_sum = toDevice(h_col_sum, q);
   const auto row = toDevice(h_row, q);
   const auto col = toDevice(h_col, q);
   const auto a = toDevice(h_a, q);
 
   constexpr int kNumStoreOps = 1;
   constexpr int kNumLdPipes = 2;
+  constexpr int kNumStPipes = 1;
   using idx_ld_pipes = PipeArray<class idx_ld_pipes_class, pair_t, 64, kNumLdPipes>;
   using val_ld_pipes = PipeArray<class val_ld_pipes_class, float, 64, kNumLdPipes>;
-  using idx_st_pipe = pipe<class idx_store_pipe_class, pair_t, 64>;
-  using val_st_pipe = pipe<class val_store_pipe_class, float, 64>;
+  using idx_st_pipes = PipeArray<class idx_store_pipe_class, pair_t, 64, kNumStPipes>;
+  using val_st_pipes = PipeArray<class val_store_pipe_class, float, 64, kNumStPipes>;
 
   using ld_a_pipe = pipe<class ld_a_class, float, 64>;
 
   using end_storeq_signal_pipe = pipe<class end_lsq_signal_class, int>;
 
+  // The column sums col_sum[row[p]] += matrix[k*M + row[p]] get a StoreQueue of their own.
+  using col_sum_idx_ld_pipes = PipeArray<class col_sum_idx_ld_pipes_class, pair_t, 64, 1>;
+  using col_sum_val_ld_pipes = PipeArray<class col_sum_val_ld_pipes_class, float, 64, 1>;
+  using col_sum_idx_st_pipes = PipeArray<class col_sum_idx_st_pipes_class, pair_t, 64, 1>;
+  using col_sum_val_st_pipes = PipeArray<class col_sum_val_st_pipes_class, float, 64, 1>;
+  using end_col_sum_storeq_signal_pipe = pipe<class end_col_sum_signal_class, int>;
+
   q.submit([&](sycl::handler &h) {
     h.single_task<class LoadA>([=]() [[intel::kernel_args_restrict]] {
       for (int k = 1; k < M; k++) {
@@ -59,6 +97,7 @@ double spmv_kernel(queue &q, std::vector<float> &h_matrix, const std::vector<int
     });
   });
 
+  auto storeq_trace = StoreQueueTraceAlloc(q, kNumLdPipes, kNumStPipes, (M - 1) * M);
   q.submit([&](sycl::handler &h) {
     h.single_task<class LoadIdx1>([=]() [[intel::kernel_args_restrict]] {
       int tag = 0;
@@ -66,6 +105,7 @@ double spmv_kernel(queue &q, std::vector<float> &h_matrix, const std::vector<int
         for (int p = 0; p < M; p++) {
           auto load_idx_1 = (k - 1) * M + col[p];
           idx_ld_pipes::PipeAt<0>::write({load_idx_1, tag * kNumStoreOps + 0});
+          StoreQueueTraceLoad(storeq_trace, 0, {load_idx_1, tag * kNumStoreOps + 0});
 
           tag++;
         }
@@ -80,6 +120,7 @@ double spmv_kernel(queue &q, std::vector<float> &h_matrix, const std::vector<int
         for (int p = 0; p < M; p++) {
           auto load_idx_2 = k * M + row[p];
           idx_ld_pipes::PipeAt<1>::write({load_idx_2, tag * kNumStoreOps + 0});
+          StoreQueueTraceLoad(storeq_trace, 1, {load_idx_2, tag * kNumStoreOps + 0});
 
           tag++;
         }
@@ -94,7 +135,8 @@ double spmv_kernel(queue &q, std::vector<float> &h_matrix, const std::vector<int
         for (int p = 0; p < M; p++) {
           auto store_idx = k * M + row[p];
 
-          idx_st_pipe::write({store_idx, tag * kNumStoreOps + 1});
+          idx_st_pipes::PipeAt<0>::write({store_idx, tag * kNumStoreOps + 1});
+          StoreQueueTraceStore(storeq_trace, 0, {store_idx, tag * kNumStoreOps + 1});
           tag++;
         }
       }
@@ -102,8 +144,29 @@ double spmv_kernel(queue &q, std::vector<float> &h_matrix, const std::vector<int
     });
   });
 
-  auto storeqEvent = StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipe, val_st_pipe,
-                                end_storeq_signal_pipe, Q_SIZE>(q, device_ptr<float>(matrix));
+  q.submit([&](sycl::handler &h) {
+    h.single_task<class ColSumIdxs>([=]() [[intel::kernel_args_restrict]] {
+      int tag = 0;
+      for (int k = 1; k < M; k++) {
+        for (int p = 0; p < M; p++) {
+          col_sum_idx_ld_pipes::PipeAt<0>::write({row[p], tag * kNumStoreOps + 0});
+          col_sum_idx_st_pipes::PipeAt<0>::write({row[p], tag * kNumStoreOps + 1});
+          tag++;
+        }
+      }
+    });
+  });
+
+  // The stats (and the trace) are those of the matrix StoreQueue.
+  auto storeq_stats = StoreQueueStatsAlloc(q);
+  auto storeqEvent = 
+      StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipes, val_st_pipes, kNumStPipes,
+                 end_storeq_signal_pipe, StoreQueueConfig<IS_FORWARDING_Q>>
+                     (q, device_ptr<float>(matrix), storeq_stats);
+  auto colSumStoreqEvent = 
+      StoreQueue<col_sum_idx_ld_pipes, col_sum_val_ld_pipes, 1, col_sum_idx_st_pipes, 
+                 col_sum_val_st_pipes, 1, end_col_sum_storeq_signal_pipe, 
+                 ColSumStoreQueueConfig<IS_FORWARDING_Q>>(q, device_ptr<float>(col_sum));
 
   auto event = q.submit([&](sycl::handler &h) {
     h.single_task<class spmv_dynamic>([=]() [[intel::kernel_args_restrict]] {
@@ -114,22 +177,31 @@ double spmv_kernel(queue &q, std::vector<float> &h_matrix, const std::vector<int
           auto load_x_2 = val_ld_pipes::PipeAt<1>::read(); // matrix[k*M + row[p]];
           auto load_a = ld_a_pipe::read();
 
+          auto load_col_sum = col_sum_val_ld_pipes::PipeAt<0>::read(); // col_sum[row[p]];
+
           auto store_x = load_x_2 + load_a * load_x_1;
 
-          val_st_pipe::write(store_x);
+          val_st_pipes::PipeAt<0>::write(store_x);
+          col_sum_val_st_pipes::PipeAt<0>::write(load_col_sum + store_x);
           total_req_stores++;
         }
       }
 
       end_storeq_signal_pipe::write(total_req_stores);
+      end_col_sum_storeq_signal_pipe::write(total_req_stores);
     });
   });
 
 
   storeqEvent.wait();
+  colSumStoreqEvent.wait();
 
   q.memcpy(h_matrix.data(), matrix, sizeof(h_matrix[0]) * h_matrix.size()).wait();
+  q.memcpy(h_col_sum.data(), col_sum, sizeof(h_col_sum[0]) * h_col_sum.size()).wait();
+  StoreQueueStatsCopyAndFree(storeq_stats, h_storeq_stats, q);
+  StoreQueueTraceSaveAndFree(storeq_trace, "spmv.sqtrace", q);
   sycl::free(matrix, q);
+  sycl::free(col_sum, q);
   sycl::free(row, q);
   sycl::free(col, q);
   sycl::free(a, q);
@@ -17,6 +17,7 @@ using namespace fpga_tools;
 
 double spmv_kernel(queue &q, 
                    std::vector<float> &h_matrix,       
+                   std::vector<float> &h_col_sum,
                    const std::vector<int> &h_row,
                    const std::vector<int> &h_col,
                    const std::vector<float> &h_a,             
@@ -25,6 +26,7 @@ double spmv_kernel(queue &q,
   std::cout << "Static HLS\n";
 
   float *matrix = toDevice(h_matrix, q);
+  float *col_sum = toDevice(h_col_sum, q);
   int *row = toDevice(h_row, q);
   int *col = toDevice(h_col, q);
   float *a = toDevice(h_a, q);
@@ -33,14 +35,17 @@ double spmv_kernel(queue &q,
     for (int k = 1; k < M; k++) {
       for (int p = 0; p < M; p++) {
         matrix[k*M + row[p]] += a[p] * matrix[(k - 1) * M + col[p]];
+        col_sum[row[p]] += matrix[k*M + row[p]];
       }
     }
   });
 
   event.wait();
   q.memcpy(h_matrix.data(), matrix, sizeof(h_matrix[0])*h_matrix.size()).wait();
+  q.memcpy(h_col_sum.data(), col_sum, sizeof(h_col_sum[0])*h_col_sum.size()).wait();
 
   sycl::free(matrix, q);  
+  sycl::free(col_sum, q);  
   sycl::free(row, q);  
   sycl::free(col, q);  
   sycl::free(a, q);  
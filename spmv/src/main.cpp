@@ -13,24 +13,12 @@
   #include "kernel_dynamic.hpp"
 #endif
 
+#include "benchmark_harness.hpp"
+
 using namespace sycl;
 
 enum data_distribution { ALL_WAIT, NO_WAIT, PERCENTAGE_WAIT };
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 void init_data(std::vector<float> &matrix, std::vector<float> &a, std::vector<int> &col_index,
                std::vector<int> &row_ptr, const uint M, const data_distribution distr, 
                const uint percentage) {
@@ -82,16 +70,19 @@ uint dense2sparse(const std::vector<float> &matrix, std::vector<int> &col_index,
   return nz;
 }
 
-void spmv_cpu(std::vector<float> &matrix, const std::vector<int> &row, const std::vector<int> &col,
-              std::vector<float> &a, const int M) {
+void spmv_cpu(std::vector<float> &matrix, std::vector<float> &col_sum, const std::vector<int> &row, 
+              const std::vector<int> &col, std::vector<float> &a, const int M) {
   for (int k = 1; k < M; k++) {
     for (int p = 0; p < M; p++) {
       matrix[k * M + row[p]] += a[p] * matrix[(k - 1) * M + col[p]];
+      col_sum[row[p]] += matrix[k * M + row[p]];
     }
   }
 }
 
 int main(int argc, char *argv[]) {
+  BenchmarkHarness harness("spmv", argc, argv);
+
   // Get A_SIZE and forward/no-forward from args.
   // defaulats
   uint M = 64;
@@ -113,20 +104,12 @@ int main(int argc, char *argv[]) {
     std::cout << "Incorrect argv.\nUsage:\n";
     std::cout << "  ./hist [ARRAY_SIZE] [data_distribution (0/1/2)] [PERCENTAGE (only for data_distr 2)]\n";
     std::cout << "    0 - all_wait, 1 - no_wait, 2 - PERCENTAGE wait\n";
+    std::cout << "    [--warmup=N] [--repeats=N] [--json=FILE] (see benchmark_harness.hpp)\n";
     std::terminate();
   }
 
-#if FPGA_EMULATOR
-  ext::intel::fpga_emulator_selector d_selector;
-#elif FPGA
-  ext::intel::fpga_selector d_selector;
-#else
-  default_selector d_selector;
-#endif
   try {
-    // Enable profiling.
-    property_list properties{property::queue::enable_profiling()};
-    queue q(d_selector, exception_handler, properties);
+    queue q = harness.make_queue();
 
     // Print out the device information used for the kernel code.
     std::cout << "Running on device: " << q.get_device().get_info<info::device::name>() << "\n";
@@ -134,29 +117,54 @@ int main(int argc, char *argv[]) {
     std::vector<float> matrix(M * M);
     std::vector<float> golden_matrix(M * M);
     std::vector<float> a(M);
+    // Sum of the values written to every column of the matrix.
+    std::vector<float> col_sum(M, 0);
+    std::vector<float> golden_col_sum(M, 0);
 
     std::vector<int> row_ptr(M);
     std::vector<int> col_index(M);
 
     init_data(matrix, a, col_index, row_ptr, M, DATA_DISTR, PERCENTAGE);
     std::copy(matrix.begin(), matrix.end(), golden_matrix.begin());
-    spmv_cpu(golden_matrix, row_ptr, col_index, a, M);
-
-    auto kernel_time = spmv_kernel(q, matrix, row_ptr, col_index, a, M);
+    spmv_cpu(golden_matrix, golden_col_sum, row_ptr, col_index, a, M);
+
+    // The kernel updates matrix and col_sum in place, every run starts from the initial ones.
+    const std::vector<float> matrix_init(matrix);
+    auto reset = [&]() { 
+      std::copy(matrix_init.begin(), matrix_init.end(), matrix.begin()); 
+      std::fill(col_sum.begin(), col_sum.end(), 0);
+    };
+    #if STOREQ_STATS && !static_sched
+      StoreQueueStats storeq_stats;
+      harness.run(int64_t(M) * M, reset, [&]() {
+        return spmv_kernel(q, matrix, col_sum, row_ptr, col_index, a, M, &storeq_stats);
+      });
+    #else
+      harness.run(int64_t(M) * M, reset,
+                  [&]() { return spmv_kernel(q, matrix, col_sum, row_ptr, col_index, a, M); });
+    #endif
 
     // Wait for all work to finish.
     q.wait();
 
-    std::cout << "Kernel time (ms): " << kernel_time << "\n";
+    #if STOREQ_STATS && !static_sched
+      storeq_stats.print();
+    #endif
 
-    if (std::equal(matrix.begin(), matrix.end(), golden_matrix.begin())) {
+    const bool is_passed = std::equal(matrix.begin(), matrix.end(), golden_matrix.begin()) &&
+                           std::equal(col_sum.begin(), col_sum.end(), golden_col_sum.begin());
+    if (is_passed) {
       std::cout << "Passed\n";
     } else {
       std::cerr << "Failed";
       std::cout << " sum(matrix) = " << std::accumulate(matrix.begin(), matrix.end(), 0.0) << "\n";
       std::cout << " sum(golden_matrix) = " << std::accumulate(golden_matrix.begin(), 
                                                                golden_matrix.end(), 0.0) << "\n";
+      std::cout << " sum(col_sum) = " << std::accumulate(col_sum.begin(), col_sum.end(), 0.0) 
+                << ", sum(golden_col_sum) = " << std::accumulate(golden_col_sum.begin(), 
+                                                                 golden_col_sum.end(), 0.0) << "\n";
     }
+    harness.report(is_passed);
 
   } catch (exception const &e) {
     std::cout << "An exception was caught.\n";
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "store_queue_model.hpp"
+#include "../../histogram/src/tables.hpp"
+
+// The QUEUE_SIZEs swept by the model (the ones listed in batch.sh and build_all.py).
+using ModelQueueSizes = std::integer_sequence<int, 1, 2, 4, 8, 16, 32, 64>;
+
+enum data_distribution { ALL_WAIT, NO_WAIT, PERCENTAGE_WAIT };
+
+// Makes fresh ld and st streams for every model run.
+using MakeStreams = std::function<void(std::vector<StoreQueueModelStream> &ld_streams,
+                                       std::vector<StoreQueueModelStream> &st_streams)>;
+
+// The hist[feature[i]] += weight[i] stream of one port, generated on the fly with the feature
+// distribution of histogram/src/main.cpp and the tags of its dynamic kernel: load i has tag i,
+// store i has tag i+1 (tag_offset). Every port draws the same features from its own generator.
+StoreQueueModelStream histogram_stream(const int64_t array_size, const data_distribution distr,
+                                       const int percentage, const int tag_offset) {
+  std::default_random_engine generator;
+  std::uniform_int_distribution<int> distribution(0, 100);
+  auto dice = std::bind (distribution, generator);
+
+  return [=, i = int64_t(0), feature_prev = 0](idx_tag_t &req) mutable {
+    if (i == array_size)
+      return false;
+
+    int feature;
+    if (distr == data_distribution::ALL_WAIT)
+      feature = (array_size >= 4) ? random_indx_1024[i % 1024] : i % array_size;
+    else if (distr == data_distribution::NO_WAIT)
+      feature = i;
+    else
+      feature = (dice() <= percentage) ? feature_prev : i;
+    feature_prev = feature;
+
+    req = {feature, int(i) + tag_offset};
+    i++;
+    return true;
+  };
+}
+
+template <int NUM_LD_PORTS, int NUM_ST_PORTS, int Q_SIZE, bool IS_FORWARDING_Q>
+void run_model(const MakeStreams &make_streams, bool is_verbose) {
+  std::vector<StoreQueueModelStream> ld_streams, st_streams;
+  make_streams(ld_streams, st_streams);
+  auto stats = StoreQueueModel<NUM_LD_PORTS, NUM_ST_PORTS, Q_SIZE, IS_FORWARDING_Q>(ld_streams,
+                                                                                 st_streams);
+  const double cycles_per_store = double(stats.num_cycles) / std::max(stats.num_stores, 
+                                                                      int64_t(1));
+
+  std::cout << std::setw(6) << Q_SIZE << std::setw(12) << (IS_FORWARDING_Q ? "yes" : "no")
+            << std::setw(14) << stats.num_cycles << std::setw(14) << std::fixed
+            << std::setprecision(2) << cycles_per_store
+            << (stats.is_deadlock ? "  (deadlock)" : "") << "\n";
+  if (is_verbose)
+    stats.print();
+}
+
+template <int NUM_LD_PORTS, int NUM_ST_PORTS, int... Qs>
+void sweep_queue_sizes(std::integer_sequence<int, Qs...>, const MakeStreams &make_streams,
+                       bool is_verbose) {
+  std::cout << std::setw(6) << "Q_SIZE" << std::setw(12) << "forwarding" << std::setw(14)
+            << "cycles" << std::setw(14) << "cycles/store" << "\n";
+  (run_model<NUM_LD_PORTS, NUM_ST_PORTS, Qs, true>(make_streams, is_verbose), ...);
+  (run_model<NUM_LD_PORTS, NUM_ST_PORTS, Qs, false>(make_streams, is_verbose), ...);
+}
+
+// Replays the streams of a trace recorded with make TRACE=1 (1 or 2 load and store ports). The
+// requests are read in place from the mapped file.
+bool sweep_trace(const char *filename, bool is_verbose) {
+  StoreQueueTraceMap trace(filename);
+  if (!trace.is_valid()) {
+    std::cout << "Cannot read StoreQueue trace " << filename << "\n";
+    return false;
+  }
+  const int num_ld_ports = trace.num_ld_ports();
+  const int num_st_ports = trace.num_st_ports();
+  MakeStreams make_streams = [&](std::vector<StoreQueueModelStream> &ld_streams,
+                                 std::vector<StoreQueueModelStream> &st_streams) {
+    for (int p = 0; p < num_ld_ports + num_st_ports; ++p) {
+      auto &streams = (p < num_ld_ports) ? ld_streams : st_streams;
+      streams.push_back([&trace, p, i = int64_t(0)](idx_tag_t &req) mutable {
+        if (i == trace.num_reqs(p))
+          return false;
+        req = trace.reqs(p)[i++];
+        return true;
+      });
+    }
+  };
+
+  std::cout << filename << ", " << num_ld_ports << " load ports, " << num_st_ports
+            << " store ports\n";
+  const int ports = num_ld_ports * 10 + num_st_ports;
+  if (ports == 11)
+    sweep_queue_sizes<1, 1>(ModelQueueSizes{}, make_streams, is_verbose);
+  else if (ports == 12)
+    sweep_queue_sizes<1, 2>(ModelQueueSizes{}, make_streams, is_verbose);
+  else if (ports == 21)
+    sweep_queue_sizes<2, 1>(ModelQueueSizes{}, make_streams, is_verbose);
+  else if (ports == 22)
+    sweep_queue_sizes<2, 2>(ModelQueueSizes{}, make_streams, is_verbose);
+  else
+    std::cout << "Unsupported number of ports.\n";
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  // A trace file instead of an ARRAY_SIZE.
+  if (argc > 1 && !isdigit(argv[1][0]))
+    return sweep_trace(argv[1], argc > 2 && atoi(argv[2]) != 0) ? 0 : 1;
+
+  // Get A_SIZE and data distribution from args.
+  // defaults
+  int64_t ARRAY_SIZE = 1000000;
+  auto DATA_DISTR = data_distribution::ALL_WAIT;
+  int PERCENTAGE = 5;
+  bool IS_VERBOSE = false;
+  try {
+    if (argc > 1) {
+      ARRAY_SIZE = atoll(argv[1]);
+    }
+    if (argc > 2) {
+      DATA_DISTR = data_distribution(atoi(argv[2]));
+    }
+    if (argc > 3) {
+      PERCENTAGE = int(atoi(argv[3]));
+      if (PERCENTAGE < 0 || PERCENTAGE > 100) throw std::invalid_argument("Invalid percentage.");
+    }
+    if (argc > 4) {
+      IS_VERBOSE = (atoi(argv[4]) != 0);
+    }
+  } catch (std::exception const &e) {
+    std::cout << "Incorrect argv.\nUsage:\n";
+    std::cout << "  ./store_queue_model [ARRAY_SIZE] [data_distribution (0/1/2)] [PERCENTAGE] "
+                 "[verbose (0/1)]\n";
+    std::cout << "  ./store_queue_model TRACE_FILE [verbose (0/1)]\n";
+    std::cout << "    0 - all_wait, 1 - no_wait, 2 - PERCENTAGE wait\n";
+    std::terminate();
+  }
+
+  MakeStreams make_streams = [&](std::vector<StoreQueueModelStream> &ld_streams,
+                                 std::vector<StoreQueueModelStream> &st_streams) {
+    ld_streams = {histogram_stream(ARRAY_SIZE, DATA_DISTR, PERCENTAGE, 0)};
+    st_streams = {histogram_stream(ARRAY_SIZE, DATA_DISTR, PERCENTAGE, 1)};
+  };
+
+  std::cout << "histogram, ARRAY_SIZE " << ARRAY_SIZE << ", data_distribution " << DATA_DISTR
+            << "\n";
+  sweep_queue_sizes<1, 1>(ModelQueueSizes{}, make_streams, IS_VERBOSE);
+
+  return 0;
+}
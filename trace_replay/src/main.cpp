@@ -0,0 +1,250 @@
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <stdlib.h>
+#include <vector>
+
+#include <sycl/ext/intel/fpga_extensions.hpp>
+
+#include "store_queue.hpp"
+#include "memory_utils.hpp"
+#include "unrolled_loop.hpp"
+#include "benchmark_harness.hpp"
+
+using namespace sycl;
+using namespace fpga_tools;
+
+#ifndef Q_SIZE
+  #define Q_SIZE 8
+#endif
+#ifndef NUM_LD_PORTS
+  #define NUM_LD_PORTS 1
+#endif
+#ifndef NUM_ST_PORTS
+  #define NUM_ST_PORTS 1
+#endif
+
+/// The replayed StoreQueue: Q_SIZE entries, and in-band end tokens.
+struct StoreQueueConfig : StoreQueueDefaults {
+  static constexpr int kQueueSize = Q_SIZE;
+  static constexpr bool kEndTokens = true;
+};
+
+// The value a replayed store writes, and the initial value of every idx.
+constexpr int kInitVal = -1;
+inline int store_val_of(const int tag) { return tag; }
+
+template <int port> class ReplayLoadIdx;
+template <int port> class ReplayStoreIdx;
+
+// The requests of all ports in one array (in trace order, loads first), and where each port begins.
+struct replay_reqs_t {
+  const idx_tag_t *reqs;
+  int64_t offset[NUM_LD_PORTS + NUM_ST_PORTS + 1];
+};
+
+// Next request to replay in program order: a store is sent before every load with the same or a
+// larger tag (a load depends on the stores with tag <= its tag), as the benchmarks do. Returns
+// false once all requests were replayed.
+inline bool next_req(const replay_reqs_t &r, const int64_t *i_req, bool &is_store, int &port) {
+  int ld_port = -1, st_port = -1;
+  int ld_tag = INT_MAX, st_tag = INT_MAX;
+  for (int p = 0; p < NUM_LD_PORTS + NUM_ST_PORTS; ++p) {
+    const int64_t i = r.offset[p] + i_req[p];
+    const bool is_st = (p >= NUM_LD_PORTS);
+    auto &min_port = is_st ? st_port : ld_port;
+    auto &min_tag = is_st ? st_tag : ld_tag;
+    if (i < r.offset[p + 1] && (min_port < 0 || r.reqs[i].tag < min_tag)) {
+      min_port = is_st ? p - NUM_LD_PORTS : p;
+      min_tag = r.reqs[i].tag;
+    }
+  }
+
+  is_store = (st_port >= 0 && (ld_port < 0 || st_tag <= ld_tag));
+  port = is_store ? st_port : ld_port;
+  return port >= 0;
+}
+
+// The values every load should get, and the final memory.
+void replay_cpu(const replay_reqs_t &r, std::vector<int> &data, std::vector<int> &ld_vals) {
+  int64_t i_req[NUM_LD_PORTS + NUM_ST_PORTS] = {};
+  bool is_store;
+  int port;
+  while (next_req(r, i_req, is_store, port)) {
+    const int p = is_store ? NUM_LD_PORTS + port : port;
+    const int64_t i = r.offset[p] + i_req[p]++;
+    if (is_store)
+      data[r.reqs[i].idx] = store_val_of(r.reqs[i].tag);
+    else
+      ld_vals[i] = data[r.reqs[i].idx];
+  }
+}
+
+double replay_kernel(queue &q, const replay_reqs_t &h_reqs, std::vector<int> &h_data,
+                     const std::vector<int> &h_ld_vals, int &num_errors) {
+  constexpr int kNumLdPipes = NUM_LD_PORTS;
+  constexpr int kNumStPipes = NUM_ST_PORTS;
+  constexpr int kNumPorts = kNumLdPipes + kNumStPipes;
+  using idx_ld_pipes = PipeArray<class idx_ld_pipe_class, pair_t, 64, kNumLdPipes>;
+  using val_ld_pipes = PipeArray<class val_ld_pipe_class, int, 64, kNumLdPipes>;
+  using idx_st_pipes = PipeArray<class idx_st_pipe_class, pair_t, 64, kNumStPipes>;
+  using val_st_pipes = PipeArray<class val_st_pipe_class, int, 64, kNumStPipes>;
+
+  const int64_t num_reqs = h_reqs.offset[kNumPorts];
+  replay_reqs_t reqs = h_reqs;
+  reqs.reqs = toDevice(h_reqs.reqs, num_reqs, q);
+  int* ld_vals = toDevice(h_ld_vals, q);
+  int* data = toDevice(h_data, q);
+  int* errors = toDevice(&num_errors, 1, q);
+
+  // The end tokens of the store ports must not be older than any load.
+  int max_tag = 0;
+  for (int64_t i = 0; i < num_reqs; ++i)
+    max_tag = std::max(max_tag, h_reqs.reqs[i].tag);
+
+  // One address producer per port, so that no port waits for another.
+  UnrolledLoop<kNumLdPipes>([&](auto k) {
+    q.submit([&](handler &hnd) {
+      hnd.single_task<ReplayLoadIdx<k>>([=]() [[intel::kernel_args_restrict]] {
+        for (int64_t i = reqs.offset[k]; i < reqs.offset[k + 1]; ++i)
+          idx_ld_pipes::template PipeAt<k>::write({reqs.reqs[i].idx, reqs.reqs[i].tag});
+        idx_ld_pipes::template PipeAt<k>::write({kStoreQueueEnd, max_tag + 1});
+      });
+    });
+  });
+  UnrolledLoop<kNumStPipes>([&](auto s) {
+    q.submit([&](handler &hnd) {
+      hnd.single_task<ReplayStoreIdx<s>>([=]() [[intel::kernel_args_restrict]] {
+        for (int64_t i = reqs.offset[kNumLdPipes + s]; i < reqs.offset[kNumLdPipes + s + 1]; ++i)
+          idx_st_pipes::template PipeAt<s>::write({reqs.reqs[i].idx, reqs.reqs[i].tag});
+        idx_st_pipes::template PipeAt<s>::write({kStoreQueueEnd, max_tag + 1});
+      });
+    });
+  });
+
+  auto storeqEvent =
+      StoreQueue<idx_ld_pipes, val_ld_pipes, kNumLdPipes, idx_st_pipes, val_st_pipes, kNumStPipes,
+                 void, StoreQueueConfig>
+                     (q, device_ptr<int>(data));
+
+  // The in-order compute kernel: reads the load values and sends the store values in the order of
+  // the original program.
+  auto event = q.submit([&](handler &hnd) {
+    hnd.single_task<class ReplayCompute>([=]() [[intel::kernel_args_restrict]] {
+      int64_t i_req[kNumPorts] = {};
+      int num_errors = 0;
+      bool is_store;
+      int port;
+      while (next_req(reqs, i_req, is_store, port)) {
+        UnrolledLoop<kNumLdPipes>([&](auto k) {
+          if (!is_store && port == k) {
+            const int64_t i = reqs.offset[k] + i_req[k]++;
+            num_errors += (val_ld_pipes::template PipeAt<k>::read() != ld_vals[i]);
+          }
+        });
+        UnrolledLoop<kNumStPipes>([&](auto s) {
+          if (is_store && port == s) {
+            const int64_t i = reqs.offset[kNumLdPipes + s] + i_req[kNumLdPipes + s]++;
+            val_st_pipes::template PipeAt<s>::write(store_val_of(reqs.reqs[i].tag));
+          }
+        });
+      }
+
+      *errors = num_errors;
+    });
+  });
+
+  event.wait();
+  storeqEvent.wait();
+  q.copy(data, h_data.data(), h_data.size()).wait();
+  q.copy(errors, &num_errors, 1).wait();
+
+  sycl::free(const_cast<idx_tag_t *>(reqs.reqs), q);
+  sycl::free(ld_vals, q);
+  sycl::free(data, q);
+  sycl::free(errors, q);
+
+  auto start = event.get_profiling_info<info::event_profiling::command_start>();
+  auto end = event.get_profiling_info<info::event_profiling::command_end>();
+  double time_in_ms = static_cast<double>(end - start) / 1000000;
+
+  return time_in_ms;
+}
+
+int main(int argc, char *argv[]) {
+  BenchmarkHarness harness("trace_replay", argc, argv);
+
+  if (argc < 2) {
+    std::cout << "Usage:\n";
+    std::cout << "  ./trace_replay TRACE_FILE\n";
+    std::cout << "    a trace recorded by a benchmark built with make TRACE=1, replayed into a\n"
+                 "    StoreQueue with NUM_LD_PORTS/NUM_ST_PORTS ports of Q_SIZE entries.\n";
+    std::cout << "    [--warmup=N] [--repeats=N] [--json=FILE] (see benchmark_harness.hpp)\n";
+    return 1;
+  }
+
+  StoreQueueTraceMap trace(argv[1]);
+  if (!trace.is_valid()) {
+    std::cout << "Cannot read StoreQueue trace " << argv[1] << "\n";
+    return 1;
+  }
+  if (trace.num_ld_ports() != NUM_LD_PORTS || trace.num_st_ports() != NUM_ST_PORTS) {
+    std::cout << "The trace has " << trace.num_ld_ports() << " load and " << trace.num_st_ports()
+              << " store ports, rebuild with NUM_LD_PORTS=" << trace.num_ld_ports()
+              << " NUM_ST_PORTS=" << trace.num_st_ports() << "\n";
+    return 1;
+  }
+
+  // The ports are stored back to back in the mapped file.
+  replay_reqs_t reqs;
+  reqs.reqs = trace.reqs(0);
+  reqs.offset[0] = 0;
+  for (int p = 0; p < NUM_LD_PORTS + NUM_ST_PORTS; ++p)
+    reqs.offset[p + 1] = reqs.offset[p] + trace.num_reqs(p);
+
+  int max_idx = 0;
+  for (int64_t i = 0; i < reqs.offset[NUM_LD_PORTS + NUM_ST_PORTS]; ++i)
+    max_idx = std::max(max_idx, reqs.reqs[i].idx);
+
+  try {
+    queue q = harness.make_queue();
+
+    // Print out the device information used for the kernel code.
+    std::cout << "Running on device: " << q.get_device().get_info<info::device::name>() << "\n";
+
+    const int64_t num_reqs = reqs.offset[NUM_LD_PORTS + NUM_ST_PORTS];
+    std::cout << "Trace " << argv[1] << ": " << reqs.offset[NUM_LD_PORTS] << " loads, "
+              << num_reqs - reqs.offset[NUM_LD_PORTS] << " stores, Q_SIZE " << Q_SIZE << "\n";
+
+    std::vector<int> data(max_idx + 1, kInitVal);
+    std::vector<int> data_cpu(data);
+    std::vector<int> ld_vals_cpu(reqs.offset[NUM_LD_PORTS]);
+    replay_cpu(reqs, data_cpu, ld_vals_cpu);
+
+    // The replay writes data in place, every run starts from the initial values.
+    int num_errors = 0;
+    auto reset = [&]() { 
+      std::fill(data.begin(), data.end(), kInitVal); 
+      num_errors = 0;
+    };
+    harness.run(num_reqs, reset, 
+                [&]() { return replay_kernel(q, reqs, data, ld_vals_cpu, num_errors); });
+
+    // Wait for all work to finish.
+    q.wait();
+
+    const bool is_passed = 
+        (num_errors == 0 && std::equal(data.begin(), data.end(), data_cpu.begin()));
+    if (is_passed)
+      std::cout << "Passed\n";
+    else
+      std::cout << "Failed (" << num_errors << " wrong load values)\n";
+    harness.report(is_passed);
+  } catch (exception const &e) {
+    std::cout << "An exception was caught.\n";
+    std::terminate();
+  }
+
+  return 0;
+}